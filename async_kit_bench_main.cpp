@@ -0,0 +1,476 @@
+// async_kit_bench: micro benchmarks for async_kit primitives.
+//
+// Every primitive is exercised in "lanes": a lane is a chain of operations where the next operation is started only
+// after the previous one completed, so state owned by a lane is never touched by two handlers at once. Single threaded
+// run uses one lane on one thread, multi threaded run uses one lane per thread sharing one io_context. Primitives that
+// fan out within a lane (when_all, when_any) or are not thread safe themselves only get the single threaded run.
+//
+// Usage: async_kit_bench [--ops N] [--threads N] [--format csv|json]
+
+#include "async_callback.hpp"
+#include "async_combinators.hpp"
+#include "async_criticial_section.hpp"
+#include "async_hedge.hpp"
+#include "async_retry.hpp"
+#include "async_timeoutable.hpp"
+#include "bounded_async_foreach.hpp"
+#include "ordered_async_ops.hpp"
+
+#include <asio/io_context.hpp>
+#include <asio/post.hpp>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <variant>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+////////////////////////////////////////////////////////////////////////////////
+// allocations accounting
+
+namespace {
+std::atomic<std::uint64_t> g_allocations{0};
+
+// all replaced allocation functions go through these two, kept out of line so that the compiler does not pair
+// inlined std::free() with operator new at call sites (-Wmismatched-new-delete).
+[[gnu::noinline]] void* counted_alloc(std::size_t n, std::size_t alignment) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    void* p = alignment <= __STDCPP_DEFAULT_NEW_ALIGNMENT__
+                  ? std::malloc(n ? n : 1)
+                  : std::aligned_alloc(alignment, (n + alignment - 1) / alignment * alignment);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+[[gnu::noinline]] void counted_free(void* p) noexcept {
+    std::free(p);
+}
+}  // namespace
+
+void* operator new(std::size_t n) {
+    return counted_alloc(n, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+
+void* operator new[](std::size_t n) {
+    return counted_alloc(n, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+
+void* operator new(std::size_t n, std::align_val_t al) {
+    return counted_alloc(n, static_cast<std::size_t>(al));
+}
+
+void* operator new[](std::size_t n, std::align_val_t al) {
+    return counted_alloc(n, static_cast<std::size_t>(al));
+}
+
+void operator delete(void* p) noexcept {
+    counted_free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    counted_free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    counted_free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept {
+    counted_free(p);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept {
+    counted_free(p);
+}
+
+void operator delete[](void* p, std::align_val_t) noexcept {
+    counted_free(p);
+}
+
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept {
+    counted_free(p);
+}
+
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept {
+    counted_free(p);
+}
+
+namespace {
+
+////////////////////////////////////////////////////////////////////////////////
+// harness
+
+// keeps compiler from throwing away benchmarked work.
+template <class T>
+void do_not_optimize(T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+struct bench_case {
+    std::string name;
+    // posts nothing itself, called from a handler running on ctx; runs n operations one after another.
+    std::function<void(asio::io_context& ctx, std::size_t n)> run_lane;
+    // false for primitives that are not safe to drive from several threads even when their state is lane confined.
+    bool multi_threaded = true;
+};
+
+struct bench_result {
+    std::string name;
+    unsigned threads;
+    std::uint64_t ops;
+    double ns_per_op;
+    double ops_per_sec;
+    double allocs_per_op;
+};
+
+// Runs op(next) n times, each time after previous op called next(). op is expected to complete from a posted handler
+// so the chain does not grow the stack.
+template <class Op>
+void run_sequentially(std::shared_ptr<Op> op, std::size_t left) {
+    if (left == 0) {
+        return;
+    }
+    (*op)([op, left] { run_sequentially(op, left - 1); });
+}
+
+template <class Op>
+void run_sequentially(std::size_t n, Op op) {
+    run_sequentially(std::make_shared<Op>(std::move(op)), n);
+}
+
+bench_result run_case(const bench_case& c, std::size_t ops_per_lane, unsigned threads) {
+    asio::io_context ctx;
+    for (unsigned lane = 0; lane < threads; ++lane) {
+        asio::post(ctx, [&ctx, &c, ops_per_lane] { c.run_lane(ctx, ops_per_lane); });
+    }
+
+    const auto allocations_before = g_allocations.load();
+    const auto start = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> workers;
+    for (unsigned i = 1; i < threads; ++i) {
+        workers.emplace_back([&ctx] { ctx.run(); });
+    }
+    ctx.run();
+    for (auto& w : workers) {
+        w.join();
+    }
+
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    const auto allocations = g_allocations.load() - allocations_before;
+
+    const auto ops = static_cast<std::uint64_t>(ops_per_lane) * threads;
+    const auto ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    return bench_result{c.name,
+                        threads,
+                        ops,
+                        ns / static_cast<double>(ops),
+                        ns > 0 ? static_cast<double>(ops) * 1e9 / ns : 0.0,
+                        static_cast<double>(allocations) / static_cast<double>(ops)};
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// cases
+
+std::vector<bench_case> make_cases() {
+    std::vector<bench_case> cases;
+
+    cases.push_back({"async_callback_impl_t<void>", [](asio::io_context&, std::size_t n) {
+                         std::uint64_t sink = 0;
+                         for (std::size_t i = 0; i < n; ++i) {
+                             lsem::async_kit::async_callback_impl_t<void> cb = [&sink](std::error_code ec) {
+                                 sink += static_cast<std::uint64_t>(ec.value()) + 1;
+                             };
+                             cb(std::error_code());
+                             do_not_optimize(sink);
+                         }
+                     }});
+
+    cases.push_back({"async_callback_impl_t<int>", [](asio::io_context&, std::size_t n) {
+                         std::uint64_t sink = 0;
+                         for (std::size_t i = 0; i < n; ++i) {
+                             lsem::async_kit::async_callback_impl_t<int> cb = [&sink](std::error_code, int v) {
+                                 sink += static_cast<std::uint64_t>(v);
+                             };
+                             cb(std::error_code(), static_cast<int>(i));
+                             do_not_optimize(sink);
+                         }
+                     }});
+
+    cases.push_back({"checked_async_callback_impl_t<void, checks::none>", [](asio::io_context&, std::size_t n) {
+                         namespace checks = lsem::async_kit::checks;
+                         std::uint64_t sink = 0;
+                         for (std::size_t i = 0; i < n; ++i) {
+                             lsem::async_kit::checked_async_callback_impl_t<void, checks::none> cb =
+                                 [&sink](std::error_code ec) { sink += static_cast<std::uint64_t>(ec.value()) + 1; };
+                             cb(std::error_code());
+                             do_not_optimize(sink);
+                         }
+                     }});
+
+    cases.push_back({"concurrent_async_callback_impl_t<void>", [](asio::io_context&, std::size_t n) {
+                         std::uint64_t sink = 0;
+                         for (std::size_t i = 0; i < n; ++i) {
+                             lsem::async_kit::concurrent_async_callback_impl_t<void> cb =
+                                 [&sink](std::error_code ec) { sink += static_cast<std::uint64_t>(ec.value()) + 1; };
+                             cb(std::error_code());
+                             do_not_optimize(sink);
+                         }
+                     }});
+
+    cases.push_back({"async_callback_impl_t<void>(48 byte capture)", [](asio::io_context&, std::size_t n) {
+                         std::uint64_t sink = 0;
+                         std::array<std::uint64_t, 5> payload{};
+                         for (std::size_t i = 0; i < n; ++i) {
+                             lsem::async_kit::async_callback_impl_t<void> cb = [&sink, payload](std::error_code) {
+                                 sink += payload[0] + 1;
+                             };
+                             cb(std::error_code());
+                             do_not_optimize(sink);
+                         }
+                     }});
+
+    cases.push_back({"inplace_async_callback_impl_t<void, 64>(48 byte capture)", [](asio::io_context&, std::size_t n) {
+                         std::uint64_t sink = 0;
+                         std::array<std::uint64_t, 5> payload{};
+                         for (std::size_t i = 0; i < n; ++i) {
+                             lsem::async_kit::inplace_async_callback_impl_t<void, 64> cb =
+                                 [&sink, payload](std::error_code) { sink += payload[0] + 1; };
+                             cb(std::error_code());
+                             do_not_optimize(sink);
+                         }
+                     }});
+
+    cases.push_back({"shared_async_callback_impl_t<void>", [](asio::io_context&, std::size_t n) {
+                         std::uint64_t sink = 0;
+                         for (std::size_t i = 0; i < n; ++i) {
+                             auto shared = lsem::async_kit::to_shared(lsem::async_kit::async_callback_impl_t<void>(
+                                 [&sink](std::error_code) { sink++; }));
+                             // typical fan-out: completion shared between two racing operations.
+                             auto copy = shared;
+                             copy(std::error_code());
+                             do_not_optimize(sink);
+                         }
+                     }});
+
+    cases.push_back({"intrusive_shared_async_callback_impl_t<void, atomic>", [](asio::io_context&, std::size_t n) {
+                         std::uint64_t sink = 0;
+                         for (std::size_t i = 0; i < n; ++i) {
+                             lsem::async_kit::intrusive_shared_async_callback_impl_t<void> shared(
+                                 [&sink](std::error_code) { sink++; });
+                             auto copy = shared;
+                             copy(std::error_code());
+                             do_not_optimize(sink);
+                         }
+                     }});
+
+    cases.push_back({"intrusive_shared_async_callback_impl_t<void, non_atomic>", [](asio::io_context&, std::size_t n) {
+                         std::uint64_t sink = 0;
+                         for (std::size_t i = 0; i < n; ++i) {
+                             lsem::async_kit::local_shared_async_callback_impl_t<void> shared(
+                                 [&sink](std::error_code) { sink++; });
+                             auto copy = shared;
+                             copy(std::error_code());
+                             do_not_optimize(sink);
+                         }
+                     }});
+
+    cases.push_back({"when_all(3 ops)", [](asio::io_context& ctx, std::size_t n) {
+                         auto op = [&ctx](auto done) {
+                             asio::post(ctx, [done = std::move(done)]() mutable { done(std::error_code(), 1); });
+                         };
+                         run_sequentially(n, [op](auto next) {
+                             lsem::async::when_all(op, op, op)(
+                                 [next = std::move(next)](std::error_code, std::tuple<int, int, int>) { next(); });
+                         });
+                     },
+                     // operations of one call complete on several threads at once, combinator state is not atomic.
+                     false});
+
+    cases.push_back({"when_any(3 ops)", [](asio::io_context& ctx, std::size_t n) {
+                         auto op = [&ctx](auto done) {
+                             asio::post(ctx, [done = std::move(done)]() mutable { done(std::error_code(), 1); });
+                         };
+                         run_sequentially(n, [op](auto next) {
+                             lsem::async::when_any(op, op, op)(
+                                 [next = std::move(next)](std::error_code, std::variant<int, int, int>) { next(); });
+                         });
+                     },
+                     // operations of one call complete on several threads at once, combinator state is not atomic.
+                     false});
+
+    cases.push_back({"async_critical_section::async_enter", [](asio::io_context& ctx, std::size_t n) {
+                         // all waiters are queued from this handler and the section hands over the lock through
+                         // posts, so only one handler touches the section at a time.
+                         auto section = async_kit::make_async_critical_section(ctx);
+                         std::function<void()> first_exit;
+                         for (std::size_t i = 0; i < n; ++i) {
+                             section->async_enter([&first_exit, i](std::error_code, std::function<void()> exit) {
+                                 if (i == 0) {
+                                     first_exit = std::move(exit);
+                                 } else {
+                                     exit();
+                                 }
+                             });
+                         }
+                         first_exit();
+                     }});
+
+    cases.push_back({"bounded_async_foreach(16 items, limit 4)", [](asio::io_context& ctx, std::size_t n) {
+                         constexpr std::size_t batch = 16;
+                         run_sequentially(n / batch, [&ctx](auto next) {
+                             bounded_async_foreach(
+                                 4u, std::vector<int>(batch, 1), [](int, auto done) { done(std::error_code()); },
+                                 [&ctx, next = std::move(next)](std::error_code) { asio::post(ctx, next); });
+                         });
+                     }});
+
+    cases.push_back({"ordered_async_ops", [](asio::io_context& ctx, std::size_t n) {
+                         run_sequentially(n, [&ctx](auto next) {
+                             ordered_async_ops ordered(ctx);
+                             auto h = ordered(1, [next = std::move(next)](std::error_code) { next(); });
+                             h(std::error_code());
+                         });
+                     }});
+
+    cases.push_back({"async_timeoutable", [](asio::io_context& ctx, std::size_t n) {
+                         auto op = [&ctx](int v, auto done) {
+                             asio::post(ctx, [v, done = std::move(done)]() mutable { done(std::error_code(), v); });
+                         };
+                         run_sequentially(n, [&ctx, op](auto next) {
+                             lsem::async::async_timeoutable(ctx, op)(
+                                 10s, 1, [next = std::move(next)](std::error_code, int) { next(); });
+                         });
+                     }});
+
+    cases.push_back({"async_timeoutable(timing_wheel)", [](asio::io_context& ctx, std::size_t n) {
+                         auto op = [&ctx](int v, auto done) {
+                             asio::post(ctx, [v, done = std::move(done)]() mutable { done(std::error_code(), v); });
+                         };
+                         auto wheel = std::make_shared<lsem::async::timing_wheel>(ctx);
+                         run_sequentially(n, [op, wheel](auto next) {
+                             lsem::async::async_timeoutable(*wheel, op)(
+                                 10s, 1, [next = std::move(next)](std::error_code, int) { next(); });
+                         });
+                     },
+                     // wheel is driven by its own handler, which may run on another thread than the lane.
+                     false});
+
+    cases.push_back({"async_retry(success)", [](asio::io_context& ctx, std::size_t n) {
+                         auto token = std::make_shared<lsem::async::cancellation_token>();
+                         auto op = [&ctx](auto done) {
+                             asio::post(ctx, [done = std::move(done)]() mutable { done(std::error_code(), 1); });
+                         };
+                         run_sequentially(n, [&ctx, op, token](auto next) {
+                             lsem::async::async_retry(ctx, op, {}, *token)(
+                                 [next = std::move(next)](std::error_code, int) { next(); });
+                         });
+                     },
+                     // control block is released from a posted handler which races with done() on other threads.
+                     false});
+
+    cases.push_back({"async_retry(1 failure, 0 pause)", [](asio::io_context& ctx, std::size_t n) {
+                         auto token = std::make_shared<lsem::async::cancellation_token>();
+                         auto op = [&ctx, attempt = std::make_shared<unsigned>(0)](auto done) {
+                             const auto ec = ((*attempt)++ % 2 == 0) ? make_error_code(std::errc::io_error)
+                                                                     : std::error_code();
+                             asio::post(ctx, [ec, done = std::move(done)]() mutable { done(ec, 1); });
+                         };
+                         lsem::async::async_retry_opts retry_opts;
+                         retry_opts.attempts = 2;
+                         retry_opts.pause = 0s;
+                         run_sequentially(n, [&ctx, op, token, retry_opts](auto next) {
+                             lsem::async::async_retry(ctx, op, retry_opts, *token)(
+                                 [next = std::move(next)](std::error_code, int) { next(); });
+                         });
+                     },
+                     false});
+
+    cases.push_back({"async_hedge(no hedge fired)", [](asio::io_context& ctx, std::size_t n) {
+                         auto op = [&ctx](lsem::async::cancellation_token&, auto done) {
+                             asio::post(ctx, [done = std::move(done)]() mutable { done(std::error_code(), 1); });
+                         };
+                         run_sequentially(n, [&ctx, op](auto next) {
+                             lsem::async::async_hedge(ctx, op, 10s)(
+                                 [next = std::move(next)](std::error_code, int) { next(); });
+                         });
+                     }});
+
+    return cases;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// output
+
+void print_csv(const std::vector<bench_result>& results) {
+    std::cout << "name,threads,ops,ns_per_op,ops_per_sec,allocs_per_op\n";
+    for (auto& r : results) {
+        std::cout << '"' << r.name << '"' << ',' << r.threads << ',' << r.ops << ',' << r.ns_per_op << ','
+                  << r.ops_per_sec << ',' << r.allocs_per_op << '\n';
+    }
+}
+
+void print_json(const std::vector<bench_result>& results) {
+    std::cout << "[\n";
+    for (std::size_t i = 0; i < results.size(); ++i) {
+        auto& r = results[i];
+        std::cout << "  {\"name\": \"" << r.name << "\", \"threads\": " << r.threads << ", \"ops\": " << r.ops
+                  << ", \"ns_per_op\": " << r.ns_per_op << ", \"ops_per_sec\": " << r.ops_per_sec
+                  << ", \"allocs_per_op\": " << r.allocs_per_op << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    std::cout << "]\n";
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    std::size_t ops = 200000;
+    unsigned threads = std::max(2u, std::thread::hardware_concurrency());
+    std::string format = "csv";
+
+    for (int i = 1; i < argc; ++i) {
+        const bool has_value = i + 1 < argc;
+        if (!std::strcmp(argv[i], "--ops") && has_value) {
+            ops = std::strtoull(argv[++i], nullptr, 10);
+        } else if (!std::strcmp(argv[i], "--threads") && has_value) {
+            threads = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (!std::strcmp(argv[i], "--format") && has_value) {
+            format = argv[++i];
+        } else {
+            std::cerr << "usage: " << argv[0] << " [--ops N] [--threads N] [--format csv|json]\n";
+            return 1;
+        }
+    }
+    if (ops == 0 || threads == 0 || (format != "csv" && format != "json")) {
+        std::cerr << "invalid arguments\n";
+        return 1;
+    }
+
+    std::vector<bench_result> results;
+    for (auto& c : make_cases()) {
+        results.push_back(run_case(c, ops, 1));
+        if (threads > 1 && c.multi_threaded) {
+            results.push_back(run_case(c, ops, threads));
+        }
+    }
+
+    if (format == "json") {
+        print_json(results);
+    } else {
+        print_csv(results);
+    }
+}
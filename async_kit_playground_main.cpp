@@ -25,5 +25,3 @@ int main() {
 
     ctx.run();
 }
-
-// TODO: when_all_async, when_any_async
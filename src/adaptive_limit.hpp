@@ -0,0 +1,88 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <system_error>
+
+namespace lsem::async {
+
+struct adaptive_limit_opts {
+    unsigned min_limit = 1;
+    unsigned max_limit = 64;
+    unsigned initial_limit = 4;
+    // limit is multiplied by it on congestion.
+    double backoff = 0.5;
+    // item slower than latency_tolerance times baseline (smallest recent latency) is a sign of congestion, as is any
+    // error.
+    double latency_tolerance = 2.0;
+    // baseline is the smallest latency of the current and the previous window of that many items.
+    unsigned window = 100;
+};
+
+// Concurrency limit of bounded_async_foreach adapting to downstream capacity (AIMD): every item completed in time
+// raises it by 1 / limit, so by one per round of limit items, and congestion cuts it by backoff, at most once per
+// round, so that one burst of slow items counts once. Stays within [min_limit, max_limit].
+//
+// Not thread safe, may be shared by foreach calls of one io_context thread. limit() may be read from anywhere.
+class adaptive_limit {
+   public:
+    using duration = std::chrono::steady_clock::duration;
+
+    explicit adaptive_limit(adaptive_limit_opts opts = {})
+        : m_opts(opts),
+          m_limit(std::clamp<double>(opts.initial_limit, opts.min_limit, opts.max_limit)),
+          m_published(static_cast<unsigned>(m_limit)),
+          // first congestion is acted upon right away.
+          m_since_decrease(static_cast<unsigned>(m_limit)) {
+        assert(opts.min_limit >= 1 && opts.min_limit <= opts.max_limit);
+        assert(opts.backoff > 0.0 && opts.backoff < 1.0);
+        assert(opts.window > 0);
+    }
+
+    adaptive_limit(const adaptive_limit&) = delete;
+    adaptive_limit& operator=(const adaptive_limit&) = delete;
+
+    unsigned limit() const { return m_published.load(std::memory_order_relaxed); }
+
+    // smallest recent latency, duration::max() until anything succeeded.
+    duration baseline() const { return std::min(m_window_min, m_prev_window_min); }
+
+    void on_completed(duration latency, std::error_code ec) {
+        if (!ec) {
+            m_window_min = std::min(m_window_min, latency);
+            if (++m_window_items == m_opts.window) {
+                m_prev_window_min = m_window_min;
+                m_window_min = duration::max();
+                m_window_items = 0;
+            }
+        }
+        m_since_decrease++;
+
+        const auto base = baseline();
+        const bool congested =
+            ec || (base != duration::max() &&
+                   std::chrono::duration<double>(latency) > std::chrono::duration<double>(base) * m_opts.latency_tolerance);
+        if (congested) {
+            if (m_since_decrease >= static_cast<unsigned>(m_limit)) {
+                m_limit = std::max<double>(m_opts.min_limit, m_limit * m_opts.backoff);
+                m_since_decrease = 0;
+            }
+        } else {
+            m_limit = std::min<double>(m_opts.max_limit, m_limit + 1.0 / m_limit);
+        }
+        m_published.store(static_cast<unsigned>(m_limit), std::memory_order_relaxed);
+    }
+
+   private:
+    const adaptive_limit_opts m_opts;
+    double m_limit;
+    std::atomic<unsigned> m_published;
+    duration m_window_min = duration::max();
+    duration m_prev_window_min = duration::max();
+    unsigned m_window_items = 0;
+    unsigned m_since_decrease;
+};
+
+}  // namespace lsem::async
@@ -0,0 +1,128 @@
+#include "adaptive_limit.hpp"
+#include "bounded_async_foreach.hpp"
+
+#include <asio/io_context.hpp>
+#include <asio/steady_timer.hpp>
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <vector>
+
+using namespace std::chrono_literals;
+using namespace lsem::async;
+
+TEST(adaptive_limit_tests, grows_while_items_are_fast) {
+    adaptive_limit limit({.min_limit = 1, .max_limit = 10, .initial_limit = 2});
+    EXPECT_EQ(limit.limit(), 2);
+
+    // about one up per round of limit items.
+    for (int i = 0; i < 3; ++i) {
+        limit.on_completed(1ms, {});
+    }
+    EXPECT_EQ(limit.limit(), 3);
+
+    for (int i = 0; i < 100; ++i) {
+        limit.on_completed(1ms, {});
+    }
+    EXPECT_EQ(limit.limit(), 10);
+    EXPECT_EQ(limit.baseline(), 1ms);
+}
+
+TEST(adaptive_limit_tests, backs_off_on_errors_once_per_round) {
+    adaptive_limit limit({.min_limit = 2, .max_limit = 64, .initial_limit = 16, .backoff = 0.5});
+
+    limit.on_completed(1ms, make_error_code(std::errc::connection_refused));
+    EXPECT_EQ(limit.limit(), 8);
+    // errors of items which were in flight together count once.
+    limit.on_completed(1ms, make_error_code(std::errc::connection_refused));
+    EXPECT_EQ(limit.limit(), 8);
+
+    for (int i = 0; i < 8; ++i) {
+        limit.on_completed(1ms, make_error_code(std::errc::connection_refused));
+    }
+    EXPECT_EQ(limit.limit(), 4);
+    for (int i = 0; i < 100; ++i) {
+        limit.on_completed(1ms, make_error_code(std::errc::connection_refused));
+    }
+    EXPECT_EQ(limit.limit(), 2);
+}
+
+TEST(adaptive_limit_tests, backs_off_on_latency) {
+    adaptive_limit limit({.max_limit = 64, .initial_limit = 8, .latency_tolerance = 2.0});
+    for (int i = 0; i < 8; ++i) {
+        limit.on_completed(5ms, {});
+    }
+    // within tolerance.
+    limit.on_completed(9ms, {});
+    const auto before = limit.limit();
+    EXPECT_GE(before, 8);
+
+    limit.on_completed(20ms, {});
+    EXPECT_EQ(limit.limit(), before / 2);
+}
+
+TEST(adaptive_limit_tests, baseline_follows_latency_up) {
+    adaptive_limit limit({.window = 10});
+    for (int i = 0; i < 10; ++i) {
+        limit.on_completed(1ms, {});
+    }
+    for (int i = 0; i < 20; ++i) {
+        limit.on_completed(5ms, {});
+    }
+    // after two windows slower latency is the new normal.
+    EXPECT_EQ(limit.baseline(), 5ms);
+}
+
+TEST(adaptive_limit_tests, foreach_finds_downstream_capacity) {
+    asio::io_context ctx;
+    auto limit = std::make_shared<adaptive_limit>(adaptive_limit_opts{.max_limit = 32, .initial_limit = 1});
+
+    // downstream handles 4 requests at once, the rest wait much longer.
+    unsigned running = 0, max_running = 0, processed = 0;
+    auto cb = [&](int, auto done) {
+        running++;
+        max_running = std::max(max_running, running);
+        auto timer = std::make_shared<asio::steady_timer>(ctx, running <= 4 ? 5ms : 50ms);
+        timer->async_wait([&, timer, done](std::error_code) {
+            running--;
+            processed++;
+            done(std::error_code());
+        });
+    };
+
+    std::optional<std::error_code> result;
+    bounded_async_foreach(limit, std::vector<int>(100), cb, [&](std::error_code ec) { result = ec; });
+    ctx.run();
+
+    EXPECT_EQ(result, std::error_code());
+    EXPECT_EQ(processed, 100);
+    EXPECT_GE(max_running, 2);
+    EXPECT_LT(max_running, 12);
+    EXPECT_LT(limit->limit(), 12);
+
+    // the next run starts from what was learned.
+    const auto learned = limit->limit();
+    unsigned first_batch = 0;
+    bounded_async_foreach(
+        limit, std::vector<int>(100),
+        [&](int, auto done) { first_batch++; },
+        [](std::error_code) {});
+    EXPECT_EQ(first_batch, learned);
+}
+
+TEST(adaptive_limit_tests, foreach_error_lowers_limit) {
+    auto limit = std::make_shared<adaptive_limit>(adaptive_limit_opts{.initial_limit = 8});
+
+    std::optional<std::error_code> result;
+    bounded_async_foreach(
+        limit, std::vector<int>(10),
+        [&](int, auto done) { done(make_error_code(std::errc::connection_refused)); },
+        [&](std::error_code ec) { result = ec; });
+
+    EXPECT_EQ(result, make_error_code(std::errc::connection_refused));
+    EXPECT_EQ(limit->limit(), 4);
+}
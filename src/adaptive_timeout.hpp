@@ -0,0 +1,123 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+namespace lsem::async {
+
+struct adaptive_timeout_opts {
+    // timeout is percentile of observed latencies times factor, clamped to [floor, cap].
+    double percentile = 0.99;
+    double factor = 2.0;
+    std::chrono::steady_clock::duration floor = std::chrono::milliseconds(10);
+    std::chrono::steady_clock::duration cap = std::chrono::seconds(30);
+    // used until min_samples latencies are observed.
+    std::chrono::steady_clock::duration initial = std::chrono::seconds(1);
+    unsigned min_samples = 20;
+    // every window samples weight of everything observed before is halved, so estimate follows latency changes.
+    unsigned window = 1000;
+};
+
+// Timeout of one call site learned from latencies of its completed calls. Latencies go to a histogram with 4
+// logarithmic buckets per octave (1us .. ~1h, at most 19% error), percentile is recomputed from it every few samples,
+// so both record() and timeout() are O(1) on average and lock free. Safe to share between threads.
+class adaptive_timeout {
+   public:
+    using duration = std::chrono::steady_clock::duration;
+
+    explicit adaptive_timeout(adaptive_timeout_opts opts = {})
+        : m_opts(opts), m_timeout(clamp(opts.initial).count()) {
+        assert(opts.percentile > 0.0 && opts.percentile <= 1.0);
+        assert(opts.floor <= opts.cap);
+        assert(opts.window >= 2 * opts.min_samples);
+    }
+
+    adaptive_timeout(const adaptive_timeout&) = delete;
+    adaptive_timeout& operator=(const adaptive_timeout&) = delete;
+
+    duration timeout() const { return duration(m_timeout.load(std::memory_order_relaxed)); }
+
+    // Calls that timed out should be recorded with the timeout they were given, so that the estimate can grow when
+    // latency goes up.
+    void record(duration latency) {
+        m_counts[bucket_of(latency)].fetch_add(1, std::memory_order_relaxed);
+        const auto n = m_samples.fetch_add(1, std::memory_order_relaxed) + 1;
+        if (n == m_opts.window) {
+            decay();
+        }
+        if (n >= m_opts.min_samples && (n == m_opts.min_samples || n % recompute_every == 0)) {
+            const auto estimate = std::chrono::duration_cast<duration>(percentile(m_opts.percentile) * m_opts.factor);
+            m_timeout.store(clamp(estimate).count(), std::memory_order_relaxed);
+        }
+    }
+
+    // Upper bound of the histogram bucket holding percentile p of recorded latencies, zero when nothing recorded.
+    duration percentile(double p) const {
+        std::array<std::uint32_t, buckets> counts;
+        std::uint64_t total = 0;
+        for (std::size_t i = 0; i < buckets; ++i) {
+            counts[i] = m_counts[i].load(std::memory_order_relaxed);
+            total += counts[i];
+        }
+        if (total == 0) {
+            return duration::zero();
+        }
+        const auto target = static_cast<std::uint64_t>(std::ceil(p * static_cast<double>(total)));
+        std::uint64_t seen = 0;
+        for (std::size_t i = 0; i < buckets; ++i) {
+            seen += counts[i];
+            if (seen >= target) {
+                return upper_bound(i);
+            }
+        }
+        return upper_bound(buckets - 1);
+    }
+
+    std::uint64_t samples() const { return m_samples.load(std::memory_order_relaxed); }
+
+   private:
+    static constexpr std::size_t buckets_per_octave = 4;
+    static constexpr std::size_t buckets = 32 * buckets_per_octave;
+    static constexpr std::size_t recompute_every = 16;
+    static constexpr auto base = std::chrono::microseconds(1);
+
+    // bucket 0 is [0, base), bucket i is [base * 2^((i-1)/4), base * 2^(i/4)).
+    static std::size_t bucket_of(duration latency) {
+        const double ratio = std::chrono::duration<double>(latency) / base;
+        if (ratio < 1.0) {
+            return 0;
+        }
+        const auto i = static_cast<std::size_t>(std::log2(ratio) * buckets_per_octave) + 1;
+        return std::min(i, buckets - 1);
+    }
+
+    static duration upper_bound(std::size_t i) {
+        return std::chrono::duration_cast<duration>(std::chrono::duration<double, std::micro>(
+            std::exp2(static_cast<double>(i) / buckets_per_octave)));
+    }
+
+    duration clamp(duration d) const { return std::clamp(d, m_opts.floor, m_opts.cap); }
+
+    void decay() {
+        std::uint64_t dropped = 0;
+        for (auto& c : m_counts) {
+            const auto before = c.load(std::memory_order_relaxed);
+            c.fetch_sub(before - before / 2, std::memory_order_relaxed);
+            dropped += before - before / 2;
+        }
+        m_samples.fetch_sub(dropped, std::memory_order_relaxed);
+    }
+
+    const adaptive_timeout_opts m_opts;
+    std::array<std::atomic<std::uint32_t>, buckets> m_counts{};
+    std::atomic<std::uint64_t> m_samples{0};
+    std::atomic<duration::rep> m_timeout;
+};
+
+}  // namespace lsem::async
@@ -0,0 +1,104 @@
+#include "adaptive_timeout.hpp"
+#include "async_timeoutable.hpp"
+
+#include <asio/io_context.hpp>
+#include <asio/steady_timer.hpp>
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <vector>
+
+using namespace std::chrono_literals;
+using namespace lsem::async;
+
+TEST(adaptive_timeout_tests, initial_timeout_until_enough_samples) {
+    adaptive_timeout policy({.factor = 2.0, .initial = 500ms, .min_samples = 10});
+
+    EXPECT_EQ(policy.timeout(), 500ms);
+    for (int i = 0; i < 9; ++i) {
+        policy.record(20ms);
+    }
+    EXPECT_EQ(policy.timeout(), 500ms);
+
+    policy.record(20ms);
+    // 20ms falls into bucket up to 2^(58/4)us ~= 23ms.
+    EXPECT_GE(policy.timeout(), 40ms);
+    EXPECT_LT(policy.timeout(), 48ms);
+}
+
+TEST(adaptive_timeout_tests, timeout_follows_percentile) {
+    adaptive_timeout policy({.percentile = 0.99, .factor = 1.0, .floor = 1ms});
+
+    // 2% of calls are slow, so p99 is slow one.
+    for (int i = 0; i < 500; ++i) {
+        policy.record(i % 50 == 0 ? 100ms : 5ms);
+    }
+    EXPECT_GE(policy.percentile(0.99), 100ms);
+    EXPECT_LT(policy.percentile(0.99), 120ms);
+    EXPECT_GE(policy.percentile(0.5), 5ms);
+    EXPECT_LT(policy.percentile(0.5), 6ms);
+    EXPECT_EQ(policy.timeout(), policy.percentile(0.99));
+}
+
+TEST(adaptive_timeout_tests, timeout_is_clamped) {
+    adaptive_timeout fast({.factor = 2.0, .floor = 10ms, .cap = 1s, .min_samples = 1, .window = 100});
+    adaptive_timeout slow({.factor = 2.0, .floor = 10ms, .cap = 1s, .min_samples = 1, .window = 100});
+    for (int i = 0; i < 32; ++i) {
+        fast.record(10us);
+        slow.record(5s);
+    }
+    EXPECT_EQ(fast.timeout(), 10ms);
+    EXPECT_EQ(slow.timeout(), 1s);
+}
+
+TEST(adaptive_timeout_tests, old_samples_fade_out) {
+    adaptive_timeout policy({.percentile = 0.5, .factor = 1.0, .floor = 1ms, .window = 100});
+
+    for (int i = 0; i < 100; ++i) {
+        policy.record(5ms);
+    }
+    EXPECT_LT(policy.timeout(), 6ms);
+
+    // latency went up, after a few windows median follows it.
+    for (int i = 0; i < 200; ++i) {
+        policy.record(50ms);
+    }
+    EXPECT_GE(policy.timeout(), 50ms);
+    EXPECT_LT(policy.samples(), 100);
+}
+
+TEST(adaptive_timeout_tests, async_timeoutable_learns_timeout) {
+    asio::io_context ctx;
+    adaptive_timeout policy({.factor = 2.0, .floor = 1ms, .initial = 1s, .min_samples = 10});
+
+    auto async_op = [&ctx](std::chrono::steady_clock::duration delay, auto done) {
+        auto timer = std::make_shared<asio::steady_timer>(ctx, delay);
+        timer->async_wait([timer, done](std::error_code) { done(std::error_code(), 42); });
+    };
+    auto op_with_timeout = async_timeoutable(ctx, policy, async_op);
+
+    for (int i = 0; i < 10; ++i) {
+        op_with_timeout(5ms, [](std::error_code ec, int r) { EXPECT_FALSE(ec); });
+        ctx.run();
+        ctx.restart();
+    }
+    EXPECT_EQ(policy.samples(), 10);
+    EXPECT_LT(policy.timeout(), 30ms);
+
+    // hung call is detected way before initial 1s.
+    std::optional<std::error_code> result;
+    const auto start = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::duration elapsed{};
+    op_with_timeout(500ms, [&](std::error_code ec, int r) {
+        result = ec;
+        elapsed = std::chrono::steady_clock::now() - start;
+    });
+    ctx.run();
+
+    EXPECT_EQ(result, make_error_code(std::errc::timed_out));
+    EXPECT_LT(elapsed, 50ms);
+    EXPECT_EQ(policy.samples(), 11);
+}
@@ -28,4 +28,9 @@ std::error_code make_error_code(async_callback_err e) {
 
 }  // namespace errors
 
+async_callback_violations_t& async_callback_violations() {
+    static async_callback_violations_t the_violations;
+    return the_violations;
+}
+
 }  // namespace lsem::async_kit
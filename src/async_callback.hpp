@@ -1,14 +1,23 @@
 #pragma once
 
 #include <fmt/format.h>
+#include <atomic>
 #include <cassert>
-//#include <experimental/source_location>
+#include <cstddef>
+#include <cstdint>
 #include <function2/function2.hpp>
 #include <iostream>
 #include <memory>
 #include <string>
 #include <string_view>
 #include <system_error>
+#include <type_traits>
+#include <utility>
+#include <version>
+
+#if defined(__cpp_lib_source_location)
+#include <source_location>
+#endif
 
 namespace lsem::async_kit {
 namespace errors {
@@ -29,18 +38,78 @@ struct is_error_code_enum<lsem::async_kit::errors::async_callback_err> : true_ty
 
 namespace lsem::async_kit {
 
+// Checking policies of async_callback_impl_t.
+namespace checks {
+// callback called twice is ignored and logged, callback destroyed without being called gets called with not_called.
+struct full {};
+// same guarantees as full but instead of logging violations are counted in async_callback_violations().
+struct count_only {};
+// no checks at all, callback is a plain fu2 function.
+struct none {};
+// same as full but first call wins with single compare-exchange, so callback may be completed from several threads
+// racing with each other (e.g. I/O completion against timer on multi-threaded io_context). Later calls are silently
+// ignored, only callback destroyed without being called is logged.
+struct concurrent {};
+}  // namespace checks
+
+// Global default for all callbacks that do not specify policy explicitly, e.g. -DASYNCKIT_CALLBACK_CHECKS=none.
+#ifndef ASYNCKIT_CALLBACK_CHECKS
+#define ASYNCKIT_CALLBACK_CHECKS full
+#endif
+
+namespace checks {
+using default_t = ASYNCKIT_CALLBACK_CHECKS;
+}  // namespace checks
+
+struct async_callback_violations_t {
+    std::atomic<std::uint64_t> called_twice{0};
+    std::atomic<std::uint64_t> not_called{0};
+};
+
+// Process wide counters of checks::count_only callbacks.
+async_callback_violations_t& async_callback_violations();
+
 namespace details {
 
+// Stand-in for members not needed by the policy, Tag keeps different members from sharing type so they can overlap.
+template <int Tag>
+struct nothing_t {
+    constexpr nothing_t() = default;
+    template <class U>
+    constexpr nothing_t(const U&) {}
+};
+
 template <class T>
-struct func_type {
-    using async_callback_t = fu2::unique_function<void(std::error_code, T)>;
+struct signature {
+    using type = void(std::error_code, T);
 };
 
 template <>
-struct func_type<void> {
-    using async_callback_t = fu2::unique_function<void(std::error_code)>;
+struct signature<void> {
+    using type = void(std::error_code);
+};
+
+// InplaceSize == 0 stands for default fu2 capacity which falls back to heap for big captures.
+template <std::size_t InplaceSize>
+struct capacity {
+    using type = fu2::capacity_fixed<InplaceSize>;
+};
+
+template <>
+struct capacity<0> {
+    using type = fu2::capacity_default;
+};
+
+template <class T, std::size_t InplaceSize = 0>
+struct func_type {
+    using async_callback_t =
+        fu2::function_base<true, false, typename capacity<InplaceSize>::type, true, false, typename signature<T>::type>;
 };
 
+template <class Callable, std::size_t InplaceSize>
+constexpr bool fits_inplace_v = sizeof(Callable) <= InplaceSize && alignof(std::max_align_t) % alignof(Callable) == 0 &&
+                                std::is_nothrow_move_constructible_v<Callable>;
+
 constexpr std::string_view file_name(const char* fpath) {
     size_t file_name_start_pos = 0;
     for (size_t i = 0; fpath[i]; ++i) {
@@ -55,6 +124,18 @@ static_assert(file_name("a/b") == "b");
 static_assert(file_name("a/b/c") == "c");
 static_assert(file_name("a/b/c.d") == "c.d");
 
+// Where the callback was created. std::source_location is a pointer to compiler generated static record, so keeping
+// it costs one pointer per callback; file name and line are only read when a diagnostic is printed.
+#if defined(__cpp_lib_source_location)
+using origin_t = std::source_location;
+#else
+struct origin_t {
+    static constexpr origin_t current() noexcept { return {}; }
+    constexpr const char* file_name() const noexcept { return ""; }
+    constexpr unsigned line() const noexcept { return 0; }
+};
+#endif
+
 struct default_log_fns_t {
     template <class... Args>
     static void print_error_line(std::string_view fmt_str, Args&&... args) {
@@ -64,16 +145,31 @@ struct default_log_fns_t {
 
 }  // namespace details
 
-template <class T, class LogFns = details::default_log_fns_t>
+// InplaceSize > 0 makes callback store callables in its own buffer of that size, so creating a callback never
+// allocates. Callables that do not fit are rejected at compile time.
+//
+// Checks selects checking policy (see checks namespace), defaults to ASYNCKIT_CALLBACK_CHECKS.
+template <class T,
+          class LogFns = details::default_log_fns_t,
+          std::size_t InplaceSize = 0,
+          class Checks = checks::default_t>
 class async_callback_impl_t {
+    static constexpr bool has_checks = !std::is_same_v<Checks, checks::none>;
+    static constexpr bool has_logging =
+        std::is_same_v<Checks, checks::full> || std::is_same_v<Checks, checks::concurrent>;
+    static constexpr bool is_concurrent = std::is_same_v<Checks, checks::concurrent>;
+    using called_flag_t = std::conditional_t<is_concurrent, std::atomic<bool>, bool>;
+
    public:
     async_callback_impl_t() : m_cb(nullptr) {}
 
     template <class Callable>
-    async_callback_impl_t(Callable cb/*,
-                          std::experimental::source_location sloc = std::experimental::source_location::current()*/)
-        // TODO: strip filepath from file_name.
-        : m_cb(std::move(cb)) /*,m_origin_tag(fmt::format("{}:{}", details::file_name(sloc.file_name()), sloc.line()))*/ {}
+    async_callback_impl_t(Callable cb, details::origin_t origin = details::origin_t::current())
+        : m_cb(std::move(cb)), m_origin(origin) {
+        static_assert(InplaceSize == 0 || details::fits_inplace_v<Callable, InplaceSize>,
+                      "callable does not fit into inplace storage of async_callback (too big, overaligned or "
+                      "throwing move constructor)");
+    }
 
     ~async_callback_impl_t() { handle_not_called(); }
 
@@ -82,13 +178,15 @@ class async_callback_impl_t {
 
     async_callback_impl_t(async_callback_impl_t&& rhs) {
         m_cb = std::move(rhs.m_cb);
-        m_called = rhs.m_called;
+        take_called_flag(rhs);
+        m_origin = rhs.m_origin;
     }
 
     async_callback_impl_t& operator=(async_callback_impl_t&& rhs) {
         handle_not_called();
         m_cb = std::move(rhs.m_cb);
-        m_called = rhs.m_called;
+        take_called_flag(rhs);
+        m_origin = rhs.m_origin;
         return *this;
     }
 
@@ -112,19 +210,51 @@ class async_callback_impl_t {
     void call_operator(Args&&... args) {
         static_assert(std::is_invocable_v<decltype(m_cb), Args...>, "not invocable");
 
-        if (!m_called) {
-            m_called = true;
+        if constexpr (!has_checks) {
+            m_cb(std::forward<Args>(args)...);
+        } else if (mark_called()) {
             std::invoke(m_cb, std::forward<Args>(args)...);
         } else {
-            LogFns::print_error_line("async_kit: {}: attempt to call the callback twice", m_origin_tag);
+            if constexpr (is_concurrent) {
+                // losing the race is expected, not a violation.
+            } else if constexpr (has_logging) {
+                LogFns::print_error_line("async_kit: {}:{}: attempt to call the callback twice",
+                                         details::file_name(m_origin.file_name()), m_origin.line());
+            } else {
+                async_callback_violations().called_twice.fetch_add(1, std::memory_order_relaxed);
+            }
             return;
         }
     }
 
+    // returns true for the first caller only.
+    bool mark_called() {
+        if constexpr (is_concurrent) {
+            bool expected = false;
+            return m_called.compare_exchange_strong(expected, true, std::memory_order_acq_rel,
+                                                    std::memory_order_relaxed);
+        } else {
+            return !std::exchange(m_called, true);
+        }
+    }
+
+    void take_called_flag(async_callback_impl_t& rhs) {
+        if constexpr (is_concurrent) {
+            m_called.store(rhs.m_called.load(std::memory_order_acquire), std::memory_order_relaxed);
+        } else {
+            m_called = rhs.m_called;
+        }
+    }
+
     void handle_not_called() {
-        if (m_cb) {
-            if (!m_called) {
-                LogFns::print_error_line("async_kit: {}: callback has not been called", m_origin_tag);
+        if constexpr (has_checks) {
+            if (m_cb && !m_called) {
+                if constexpr (has_logging) {
+                    LogFns::print_error_line("async_kit: {}:{}: callback has not been called",
+                                             details::file_name(m_origin.file_name()), m_origin.line());
+                } else {
+                    async_callback_violations().not_called.fetch_add(1, std::memory_order_relaxed);
+                }
                 if constexpr (std::is_invocable_v<decltype(m_cb), std::error_code>) {
                     std::exchange(m_cb, nullptr)(make_error_code(errors::async_callback_err::not_called));
                 } else {
@@ -135,11 +265,20 @@ class async_callback_impl_t {
     }
 
    private:
-    typename details::func_type<T>::async_callback_t m_cb;
-    bool m_called = false;
-    std::string m_origin_tag;
+    typename details::func_type<T, InplaceSize>::async_callback_t m_cb;
+    [[no_unique_address]] std::conditional_t<has_checks, called_flag_t, details::nothing_t<0>> m_called{};
+    [[no_unique_address]] std::conditional_t<has_logging, details::origin_t, details::nothing_t<1>> m_origin;
 };
 
+template <class T, std::size_t InplaceSize, class LogFns = details::default_log_fns_t>
+using inplace_async_callback_impl_t = async_callback_impl_t<T, LogFns, InplaceSize>;
+
+template <class T, class Checks, std::size_t InplaceSize = 0>
+using checked_async_callback_impl_t = async_callback_impl_t<T, details::default_log_fns_t, InplaceSize, Checks>;
+
+template <class T, std::size_t InplaceSize = 0>
+using concurrent_async_callback_impl_t = checked_async_callback_impl_t<T, checks::concurrent, InplaceSize>;
+
 // TODO: ensure async_callback cannot be created from shared one to prevent.
 template <class T>
 class shared_async_callback_impl_t {
@@ -173,4 +312,167 @@ shared_async_callback_impl_t<T> to_shared(async_callback_impl_t<T> cb) {
     return shared_async_callback_impl_t(std::move(cb));
 }
 
+// Reference counting policies of intrusive_shared_async_callback_impl_t.
+namespace refcount {
+struct atomic {
+    using counter_t = std::atomic<std::uint32_t>;
+    static void inc(counter_t& c) { c.fetch_add(1, std::memory_order_relaxed); }
+    // returns true when last reference is gone.
+    static bool dec(counter_t& c) { return c.fetch_sub(1, std::memory_order_acq_rel) == 1; }
+};
+
+// for callbacks that never leave one thread (e.g. single threaded io_context).
+struct non_atomic {
+    using counter_t = std::uint32_t;
+    static void inc(counter_t& c) { ++c; }
+    static bool dec(counter_t& c) { return --c == 0; }
+};
+}  // namespace refcount
+
+namespace details {
+
+template <class T>
+struct is_async_callback : std::false_type {};
+
+template <class T, class LogFns, std::size_t InplaceSize, class Checks>
+struct is_async_callback<async_callback_impl_t<T, LogFns, InplaceSize, Checks>> : std::true_type {};
+
+// F<Pre..., T> or F<Pre...> for void T, lets void and non-void callbacks share one definition.
+template <class T, template <class...> class F, class... Pre>
+struct apply_values {
+    using type = F<Pre..., T>;
+};
+
+template <template <class...> class F, class... Pre>
+struct apply_values<void, F, Pre...> {
+    using type = F<Pre...>;
+};
+
+template <class RefCount, class... Ts>
+struct shared_callback_block {
+    virtual ~shared_callback_block() = default;
+    virtual void call(std::error_code ec, Ts... values) = 0;
+    virtual bool has_callback() const = 0;
+
+    typename RefCount::counter_t refs{1};
+};
+
+template <class Callback, class RefCount, class... Ts>
+struct shared_callback_block_impl final : shared_callback_block<RefCount, Ts...> {
+    explicit shared_callback_block_impl(Callback cb) : cb(std::move(cb)) {}
+    void call(std::error_code ec, Ts... values) override { cb(ec, std::move(values)...); }
+    bool has_callback() const override { return static_cast<bool>(cb); }
+
+    Callback cb;
+};
+
+}  // namespace details
+
+// Copyable callback sharing one async_callback between copies, like shared_async_callback_impl_t, but reference count
+// and the callable live in one allocated block and RefCount policy lets single threaded code avoid atomic operations.
+template <class T,
+          class RefCount = refcount::atomic,
+          class LogFns = details::default_log_fns_t,
+          class Checks = checks::default_t>
+class intrusive_shared_async_callback_impl_t {
+    using block_t = typename details::apply_values<T, details::shared_callback_block, RefCount>::type;
+
+    template <class Callback>
+    using block_impl_t =
+        typename details::apply_values<T, details::shared_callback_block_impl, Callback, RefCount>::type;
+
+    // callable is stored inline in async_callback which itself is inline in the block.
+    template <class Callable>
+    static constexpr std::size_t inplace_size_v =
+        details::fits_inplace_v<Callable, sizeof(Callable)> ? sizeof(Callable) : 0;
+
+    template <class Callable>
+    using stored_callback_t = std::conditional_t<details::is_async_callback<Callable>::value,
+                                                 Callable,
+                                                 async_callback_impl_t<T, LogFns, inplace_size_v<Callable>, Checks>>;
+
+   public:
+    template <class Callable,
+              typename = std::enable_if_t<!std::is_same_v<Callable, intrusive_shared_async_callback_impl_t>>>
+    explicit intrusive_shared_async_callback_impl_t(Callable cb,
+                                                    details::origin_t origin = details::origin_t::current()) {
+        if constexpr (details::is_async_callback<Callable>::value) {
+            m_block = new block_impl_t<Callable>(std::move(cb));
+        } else {
+            m_block = new block_impl_t<stored_callback_t<Callable>>(stored_callback_t<Callable>(std::move(cb), origin));
+        }
+    }
+
+    ~intrusive_shared_async_callback_impl_t() { release(); }
+
+    intrusive_shared_async_callback_impl_t(const intrusive_shared_async_callback_impl_t& rhs) : m_block(rhs.m_block) {
+        if (m_block) {
+            RefCount::inc(m_block->refs);
+        }
+    }
+
+    intrusive_shared_async_callback_impl_t(intrusive_shared_async_callback_impl_t&& rhs) noexcept
+        : m_block(std::exchange(rhs.m_block, nullptr)) {}
+
+    intrusive_shared_async_callback_impl_t& operator=(const intrusive_shared_async_callback_impl_t& rhs) {
+        if (this != &rhs) {
+            release();
+            m_block = rhs.m_block;
+            if (m_block) {
+                RefCount::inc(m_block->refs);
+            }
+        }
+        return *this;
+    }
+
+    intrusive_shared_async_callback_impl_t& operator=(intrusive_shared_async_callback_impl_t&& rhs) noexcept {
+        if (this != &rhs) {
+            release();
+            m_block = std::exchange(rhs.m_block, nullptr);
+        }
+        return *this;
+    }
+
+    template <typename EnableWhenVoid = std::enable_if<std::is_same_v<T, void>>,
+              typename = typename EnableWhenVoid::type>
+    void operator()(const std::error_code& ec) {
+        assert(m_block);
+        m_block->call(ec);
+    }
+
+    template <typename Param = T,
+              typename EnableWhenNonVoid = std::enable_if<!std::is_same_v<T, void>>,
+              typename = typename EnableWhenNonVoid::type>
+    void operator()(const std::error_code& ec, Param&& p) {
+        assert(m_block);
+        m_block->call(ec, std::forward<Param>(p));
+    }
+
+    operator bool() const { return m_block && m_block->has_callback(); }
+
+   private:
+    void release() {
+        if (m_block && RefCount::dec(m_block->refs)) {
+            delete m_block;
+        }
+        m_block = nullptr;
+    }
+
+    block_t* m_block = nullptr;
+};
+
+template <class T>
+using local_shared_async_callback_impl_t = intrusive_shared_async_callback_impl_t<T, refcount::non_atomic>;
+
+// copies may be invoked from different threads, exactly one invocation goes through.
+template <class T>
+using concurrent_shared_async_callback_impl_t =
+    intrusive_shared_async_callback_impl_t<T, refcount::atomic, details::default_log_fns_t, checks::concurrent>;
+
+template <class RefCount = refcount::atomic, class T, class LogFns, std::size_t InplaceSize, class Checks>
+intrusive_shared_async_callback_impl_t<T, RefCount, LogFns, Checks> to_intrusive_shared(
+    async_callback_impl_t<T, LogFns, InplaceSize, Checks> cb) {
+    return intrusive_shared_async_callback_impl_t<T, RefCount, LogFns, Checks>(std::move(cb));
+}
+
 }  // namespace lsem::async_kit
\ No newline at end of file
@@ -0,0 +1,108 @@
+// Allocation accounting tests. Global allocation functions are replaced here, so this file is built into its own
+// executable (async_kit_alloc_tests) without sanitizers instead of the shared test binary.
+#include "async_callback.hpp"
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+namespace {
+// heap allocations of the calling thread.
+thread_local std::uint64_t t_allocations = 0;
+
+[[gnu::noinline]] void* counted_alloc(std::size_t n, std::size_t alignment) {
+    t_allocations++;
+    void* p = alignment <= __STDCPP_DEFAULT_NEW_ALIGNMENT__
+                  ? std::malloc(n ? n : 1)
+                  : std::aligned_alloc(alignment, (n + alignment - 1) / alignment * alignment);
+    if (!p) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+[[gnu::noinline]] void counted_free(void* p) noexcept {
+    std::free(p);
+}
+}  // namespace
+
+void* operator new(std::size_t n) {
+    return counted_alloc(n, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+
+void* operator new[](std::size_t n) {
+    return counted_alloc(n, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+
+void* operator new(std::size_t n, std::align_val_t al) {
+    return counted_alloc(n, static_cast<std::size_t>(al));
+}
+
+void* operator new[](std::size_t n, std::align_val_t al) {
+    return counted_alloc(n, static_cast<std::size_t>(al));
+}
+
+void operator delete(void* p) noexcept {
+    counted_free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    counted_free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    counted_free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept {
+    counted_free(p);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept {
+    counted_free(p);
+}
+
+void operator delete[](void* p, std::align_val_t) noexcept {
+    counted_free(p);
+}
+
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept {
+    counted_free(p);
+}
+
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept {
+    counted_free(p);
+}
+
+TEST(async_callback_alloc_test, inplace_callback__does_not_allocate) {
+    int sum = 0;
+    std::array<char, 40> payload{};
+    payload[0] = 1;
+
+    const auto allocations_before = t_allocations;
+    {
+        lsem::async_kit::inplace_async_callback_impl_t<int, 64> cb = [&sum, payload](std::error_code ec, int arg) {
+            sum += arg + payload[0];
+        };
+        auto cb_moved = std::move(cb);
+        lsem::async_kit::inplace_async_callback_impl_t<int, 64> cb_assigned;
+        cb_assigned = std::move(cb_moved);
+        cb_assigned(std::error_code(), 41);
+    }
+    EXPECT_EQ(t_allocations - allocations_before, 0u);
+    EXPECT_EQ(sum, 42);
+}
+
+TEST(async_callback_alloc_test, regular_callback_allocates_for_big_capture) {
+    // makes sure the counter sees allocations at all.
+    std::array<char, 256> payload{};
+    const auto allocations_before = t_allocations;
+    {
+        lsem::async_kit::async_callback_impl_t<void> cb = [payload](std::error_code) { (void)payload; };
+        cb(std::error_code());
+    }
+    EXPECT_GT(t_allocations - allocations_before, 0u);
+}
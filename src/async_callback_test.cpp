@@ -3,6 +3,12 @@
 #include <asio/io_context.hpp>
 #include <asio/steady_timer.hpp>
 
+#include <array>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
 #include <vector>
 
 #include <gmock/gmock.h>
@@ -170,3 +176,193 @@ TEST(async_callback_test, shared_async_callback_basic__void) {
 
     GTEST_SKIP() << "Not implemented";
 }
+
+TEST(async_callback_test, inplace_callback__not_called__param) {
+    std::vector<std::pair<std::error_code, int>> invocations;
+    {
+        std::array<char, 40> payload{};
+        lsem::async_kit::inplace_async_callback_impl_t<int, 64> cb = [&, payload](std::error_code ec, int arg) {
+            invocations.emplace_back(ec, arg + payload[0]);
+        };
+        auto cb_moved = std::move(cb);
+        EXPECT_FALSE(cb);
+        EXPECT_TRUE(cb_moved);
+    }
+    EXPECT_THAT(invocations, ElementsAre(std::pair<std::error_code, int>{
+                                 make_error_code(errors::async_callback_err::not_called), int{}}));
+}
+
+TEST(async_callback_test, inplace_callback__called_once__void) {
+    std::vector<std::error_code> invocations;
+    lsem::async_kit::inplace_async_callback_impl_t<void, 16> cb = [&](std::error_code ec) {
+        invocations.emplace_back(ec);
+    };
+    cb(std::error_code());
+    cb(std::error_code());
+    EXPECT_THAT(invocations, ElementsAre(std::error_code()));
+}
+
+TEST(async_callback_test, inplace_callback__fit_rules) {
+    using lsem::async_kit::details::fits_inplace_v;
+    static_assert(fits_inplace_v<std::array<char, 16>, 16>);
+    static_assert(!fits_inplace_v<std::array<char, 17>, 16>);
+    static_assert(fits_inplace_v<std::unique_ptr<int>, sizeof(void*)>);
+}
+
+namespace {
+struct captured_log_fns_t {
+    static inline std::vector<std::string> lines;
+
+    template <class... Args>
+    static void print_error_line(std::string_view fmt_str, Args&&... args) {
+        lines.emplace_back(fmt::vformat(fmt_str, fmt::make_format_args(args...)));
+    }
+};
+
+template <class T>
+using logged_async_callback = lsem::async_kit::async_callback_impl_t<T, captured_log_fns_t>;
+}  // namespace
+
+TEST(async_callback_test, origin_is_reported__not_called) {
+    captured_log_fns_t::lines.clear();
+    unsigned origin_line = 0;
+    {
+        origin_line = __LINE__ + 1;
+        logged_async_callback<void> cb = [](std::error_code) {};
+        auto moved = std::move(cb);
+    }
+    EXPECT_THAT(captured_log_fns_t::lines,
+                ElementsAre(fmt::format("async_kit: async_callback_test.cpp:{}: callback has not been called",
+                                        origin_line)));
+}
+
+TEST(async_callback_test, origin_is_reported__called_twice) {
+    captured_log_fns_t::lines.clear();
+    const unsigned origin_line = __LINE__ + 1;
+    logged_async_callback<int> cb = [](std::error_code, int) {};
+    cb(std::error_code(), 1);
+    cb(std::error_code(), 2);
+    EXPECT_THAT(captured_log_fns_t::lines,
+                ElementsAre(fmt::format("async_kit: async_callback_test.cpp:{}: attempt to call the callback twice",
+                                        origin_line)));
+}
+
+TEST(async_callback_test, count_only_checks__violations_counted) {
+    namespace checks = lsem::async_kit::checks;
+    auto& violations = lsem::async_kit::async_callback_violations();
+    const auto called_twice_before = violations.called_twice.load();
+    const auto not_called_before = violations.not_called.load();
+
+    std::vector<std::error_code> invocations;
+    {
+        lsem::async_kit::checked_async_callback_impl_t<void, checks::count_only> cb = [&](std::error_code ec) {
+            invocations.emplace_back(ec);
+        };
+        cb(std::error_code());
+        cb(std::error_code());
+    }
+    {
+        lsem::async_kit::checked_async_callback_impl_t<void, checks::count_only> cb = [&](std::error_code ec) {
+            invocations.emplace_back(ec);
+        };
+    }
+
+    EXPECT_THAT(invocations,
+                ElementsAre(std::error_code(), make_error_code(errors::async_callback_err::not_called)));
+    EXPECT_EQ(violations.called_twice.load() - called_twice_before, 1u);
+    EXPECT_EQ(violations.not_called.load() - not_called_before, 1u);
+}
+
+TEST(async_callback_test, no_checks__plain_function) {
+    namespace checks = lsem::async_kit::checks;
+    using unchecked_t = lsem::async_kit::checked_async_callback_impl_t<int, checks::none>;
+    static_assert(sizeof(unchecked_t) == sizeof(lsem::async_kit::details::func_type<int>::async_callback_t));
+
+    std::vector<std::pair<std::error_code, int>> invocations;
+    {
+        unchecked_t cb = [&](std::error_code ec, int arg) { invocations.emplace_back(ec, arg); };
+        cb(std::error_code(), 1);
+        cb(std::error_code(), 2);
+    }
+    {
+        unchecked_t cb = [&](std::error_code ec, int arg) { invocations.emplace_back(ec, arg); };
+    }
+    // nothing is tracked: both calls go through and not called callback is silently dropped.
+    EXPECT_THAT(invocations, ElementsAre(std::pair<std::error_code, int>{std::error_code(), 1},
+                                         std::pair<std::error_code, int>{std::error_code(), 2}));
+}
+
+TEST(async_callback_test, intrusive_shared_callback__called_once_by_any_copy) {
+    namespace refcount = lsem::async_kit::refcount;
+    using shared_t = lsem::async_kit::intrusive_shared_async_callback_impl_t<int, refcount::non_atomic>;
+    static_assert(sizeof(shared_t) == sizeof(void*));
+
+    std::vector<std::pair<std::error_code, int>> invocations;
+    {
+        shared_t a([&](std::error_code ec, int arg) { invocations.emplace_back(ec, arg); });
+        auto b = a;
+        auto c = std::move(b);
+        EXPECT_TRUE(a);
+        EXPECT_TRUE(c);
+        c(std::error_code(), 1);
+        a(std::error_code(), 2);
+    }
+    EXPECT_THAT(invocations, ElementsAre(std::pair<std::error_code, int>{std::error_code(), 1}));
+}
+
+TEST(async_callback_test, intrusive_shared_callback__not_called_when_last_copy_gone) {
+    std::vector<std::error_code> invocations;
+    {
+        lsem::async_kit::intrusive_shared_async_callback_impl_t<void> a(
+            [&](std::error_code ec) { invocations.emplace_back(ec); });
+        {
+            auto b = a;
+        }
+        EXPECT_TRUE(invocations.empty());
+    }
+    EXPECT_THAT(invocations, ElementsAre(make_error_code(errors::async_callback_err::not_called)));
+}
+
+TEST(async_callback_test, intrusive_shared_callback__from_async_callback) {
+    std::vector<std::error_code> invocations;
+    {
+        tested_async_callback<void> cb = [&](std::error_code ec) { invocations.emplace_back(ec); };
+        auto shared = lsem::async_kit::to_intrusive_shared<lsem::async_kit::refcount::non_atomic>(std::move(cb));
+        auto copy = shared;
+        EXPECT_FALSE(cb);
+        copy(std::error_code());
+    }
+    EXPECT_THAT(invocations, ElementsAre(std::error_code()));
+}
+
+TEST(async_callback_test, concurrent_callback__first_caller_wins) {
+    // losers of the race are not reported.
+    testing::internal::CaptureStderr();
+    for (int round = 0; round < 100; ++round) {
+        std::atomic<int> invocations{0};
+        std::atomic<int> winner{-1};
+        lsem::async_kit::concurrent_shared_async_callback_impl_t<int> shared(
+            [&](std::error_code, int who) {
+                invocations++;
+                winner = who;
+            });
+
+        std::atomic<bool> go{false};
+        std::vector<std::thread> racers;
+        for (int i = 0; i < 4; ++i) {
+            racers.emplace_back([&go, i, cb = shared]() mutable {
+                while (!go) {
+                }
+                cb(std::error_code(), i);
+            });
+        }
+        go = true;
+        for (auto& t : racers) {
+            t.join();
+        }
+
+        EXPECT_EQ(invocations, 1);
+        EXPECT_NE(winner, -1);
+    }
+    EXPECT_EQ(testing::internal::GetCapturedStderr(), "");
+}
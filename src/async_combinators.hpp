@@ -0,0 +1,364 @@
+#pragma once
+
+#include "async_callback.hpp"
+#include "cancellation_token.hpp"
+#include "utils.hpp"
+
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <system_error>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+namespace lsem::async {
+
+// Combinators of callback-style operations. Operation is anything callable as op(done) which eventually calls
+// done(ec, r) (or done(ec) for operations without result). Result types are taken from signature of the final
+// callback passed to the combinator, the same way async_retry does:
+//
+//   when_all(op1, op2)([](std::error_code ec, std::tuple<int, std::string> results) { ... });
+//   when_all(std::vector{op1, op2})([](std::error_code ec, std::vector<int> results) { ... });
+//   when_any(op1, op2)([](std::error_code ec, std::variant<int, std::string> first) { ... });
+//   when_any(std::vector{op1, op2})([](std::error_code ec, std::pair<std::size_t, int> first) { ... });
+//
+// Each operation gets async_callback with inplace storage, so operation that drops its callback is completed with
+// not_called error instead of hanging the combinator. Shared state is allocated once per invocation.
+//
+// Not thread safe: operations of one invocation have to complete on a single thread or serially (e.g. through a
+// strand), not concurrently from several threads running io_context.
+
+namespace details {
+
+template <class R, class Callable>
+auto make_op_callback(Callable c) {
+    return async_kit::inplace_async_callback_impl_t<R, sizeof(Callable)>(std::move(c));
+}
+
+template <class Done, class Results>
+struct when_all_state {
+    when_all_state(Done done, Results results, std::size_t pending)
+        : done(std::move(done)), results(std::move(results)), pending(pending) {}
+
+    void on_completed(std::error_code ec) {
+        if (ec && !first_error) {
+            first_error = ec;
+        }
+        if (--pending == 0) {
+            if constexpr (std::is_invocable_v<Done&, std::error_code>) {
+                done(first_error);
+            } else {
+                done(first_error, std::move(results));
+            }
+        }
+    }
+
+    Done done;
+    Results results;
+    std::size_t pending;
+    std::error_code first_error;
+};
+
+template <class Done, class Results>
+struct when_any_state {
+    when_any_state(Done done, std::size_t pending) : done(std::move(done)), pending(pending) {}
+
+    template <class... Result>
+    void on_completed(std::error_code ec, Result&&... result) {
+        pending--;
+        if (!done) {
+            // already completed, late results are dropped.
+            return;
+        }
+        if (!ec) {
+            std::exchange(done, std::nullopt).value()(ec, std::forward<Result>(result)...);
+        } else if (pending == 0) {
+            // all failed, report last error.
+            if constexpr (std::is_invocable_v<Done&, std::error_code>) {
+                std::exchange(done, std::nullopt).value()(ec);
+            } else {
+                std::exchange(done, std::nullopt).value()(ec, Results{});
+            }
+        }
+    }
+
+    std::optional<Done> done;
+    std::size_t pending;
+};
+
+// counters, results and tokens are plain fields, completions are expected to come one at a time.
+template <class Done, class Results>
+struct when_k_state {
+    when_k_state(Done done, std::size_t n, std::size_t k) : done(std::move(done)), tokens(n), k(k), n(n) {
+        if constexpr (!std::is_void_v<Results>) {
+            results.reserve(k);
+        }
+    }
+
+    template <class... Result>
+    void on_completed(std::size_t i, std::error_code ec, Result&&... result) {
+        if (!cancelling) {
+            // nothing to cancel anymore, also prevents token from calling into completed operation on destruction.
+            tokens[i].impl = nullptr;
+        }
+        if (!done) {
+            // already completed, stragglers are dropped.
+            return;
+        }
+        if (!ec) {
+            if constexpr (!std::is_void_v<Results>) {
+                results.emplace_back(i, std::forward<Result>(result)...);
+            }
+            if (++succeeded == k) {
+                complete(std::error_code());
+            }
+        } else if (++failed > n - k) {
+            complete(ec);
+        }
+    }
+
+    void complete(std::error_code ec) {
+        auto done_cb = std::exchange(done, std::nullopt).value();
+        cancelling = true;
+        for (auto& token : tokens) {
+            token.cancel();
+        }
+        cancelling = false;
+        if constexpr (std::is_void_v<Results>) {
+            done_cb(ec);
+        } else {
+            done_cb(ec, std::move(results));
+        }
+    }
+
+    std::optional<Done> done;
+    std::vector<cancellation_token> tokens;
+    std::conditional_t<std::is_void_v<Results>, std::tuple<>, Results> results;
+    const std::size_t k;
+    const std::size_t n;
+    std::size_t succeeded = 0;
+    std::size_t failed = 0;
+    bool cancelling = false;
+};
+
+template <class Done>
+constexpr bool has_results_v = !std::is_invocable_v<Done&, std::error_code>;
+
+}  // namespace details
+
+template <class... Ops>
+auto when_all(Ops... ops) {
+    static_assert(sizeof...(Ops) > 0, "at least one operation expected");
+
+    return [ops = std::make_tuple(std::move(ops)...)](auto done) mutable {
+        using done_type = decltype(done);
+
+        if constexpr (details::has_results_v<done_type>) {
+            using results_type = utils::result_type_t<done_type>;
+            static_assert(std::tuple_size_v<results_type> == sizeof...(Ops),
+                          "done expected to accept std::tuple with result of each operation");
+            using state_type = details::when_all_state<done_type, results_type>;
+
+            auto state = std::make_shared<state_type>(std::move(done), results_type{}, sizeof...(Ops));
+            [&]<std::size_t... I>(std::index_sequence<I...>) {
+                (std::get<I>(ops)(details::make_op_callback<std::tuple_element_t<I, results_type>>(
+                     [state](std::error_code ec, std::tuple_element_t<I, results_type> r) {
+                         if (!ec) {
+                             std::get<I>(state->results) = std::move(r);
+                         }
+                         state->on_completed(ec);
+                     })),
+                 ...);
+            }(std::index_sequence_for<Ops...>{});
+        } else {
+            using state_type = details::when_all_state<done_type, std::tuple<>>;
+
+            auto state = std::make_shared<state_type>(std::move(done), std::tuple<>{}, sizeof...(Ops));
+            std::apply(
+                [&state](auto&... op) {
+                    (op(details::make_op_callback<void>([state](std::error_code ec) { state->on_completed(ec); })),
+                     ...);
+                },
+                ops);
+        }
+    };
+}
+
+template <class Op>
+auto when_all(std::vector<Op> ops) {
+    return [ops = std::move(ops)](auto done) mutable {
+        using done_type = decltype(done);
+
+        if constexpr (details::has_results_v<done_type>) {
+            using results_type = utils::result_type_t<done_type>;
+            using result_type = typename results_type::value_type;
+            using state_type = details::when_all_state<done_type, results_type>;
+
+            if (ops.empty()) {
+                done(std::error_code(), results_type{});
+                return;
+            }
+
+            auto state = std::make_shared<state_type>(std::move(done), results_type(ops.size()), ops.size());
+            for (std::size_t i = 0; i < ops.size(); ++i) {
+                ops[i](details::make_op_callback<result_type>([state, i](std::error_code ec, result_type r) {
+                    if (!ec) {
+                        state->results[i] = std::move(r);
+                    }
+                    state->on_completed(ec);
+                }));
+            }
+        } else {
+            using state_type = details::when_all_state<done_type, std::tuple<>>;
+
+            if (ops.empty()) {
+                done(std::error_code());
+                return;
+            }
+
+            auto state = std::make_shared<state_type>(std::move(done), std::tuple<>{}, ops.size());
+            for (auto& op : ops) {
+                op(details::make_op_callback<void>([state](std::error_code ec) { state->on_completed(ec); }));
+            }
+        }
+    };
+}
+
+// Completes with the first successful result, or with the last error when every operation failed.
+template <class... Ops>
+auto when_any(Ops... ops) {
+    static_assert(sizeof...(Ops) > 0, "at least one operation expected");
+
+    return [ops = std::make_tuple(std::move(ops)...)](auto done) mutable {
+        using done_type = decltype(done);
+
+        if constexpr (details::has_results_v<done_type>) {
+            using results_type = utils::result_type_t<done_type>;
+            static_assert(std::variant_size_v<results_type> == sizeof...(Ops),
+                          "done expected to accept std::variant with alternative for each operation");
+            using state_type = details::when_any_state<done_type, results_type>;
+
+            auto state = std::make_shared<state_type>(std::move(done), sizeof...(Ops));
+            [&]<std::size_t... I>(std::index_sequence<I...>) {
+                (std::get<I>(ops)(details::make_op_callback<std::variant_alternative_t<I, results_type>>(
+                     [state](std::error_code ec, std::variant_alternative_t<I, results_type> r) {
+                         state->on_completed(ec, results_type(std::in_place_index<I>, std::move(r)));
+                     })),
+                 ...);
+            }(std::index_sequence_for<Ops...>{});
+        } else {
+            using state_type = details::when_any_state<done_type, void>;
+
+            auto state = std::make_shared<state_type>(std::move(done), sizeof...(Ops));
+            std::apply(
+                [&state](auto&... op) {
+                    (op(details::make_op_callback<void>([state](std::error_code ec) { state->on_completed(ec); })),
+                     ...);
+                },
+                ops);
+        }
+    };
+}
+
+// Dynamic version, result is (index of operation, its result). Empty ops complete with std::errc::no_child_process, as
+// there is no first result to report.
+template <class Op>
+auto when_any(std::vector<Op> ops) {
+    return [ops = std::move(ops)](auto done) mutable {
+        using done_type = decltype(done);
+
+        if constexpr (details::has_results_v<done_type>) {
+            using results_type = utils::result_type_t<done_type>;
+            using result_type = typename results_type::second_type;
+            using state_type = details::when_any_state<done_type, results_type>;
+
+            if (ops.empty()) {
+                done(make_error_code(std::errc::no_child_process), results_type{});
+                return;
+            }
+
+            auto state = std::make_shared<state_type>(std::move(done), ops.size());
+            for (std::size_t i = 0; i < ops.size(); ++i) {
+                ops[i](details::make_op_callback<result_type>([state, i](std::error_code ec, result_type r) {
+                    state->on_completed(ec, results_type(i, std::move(r)));
+                }));
+            }
+        } else {
+            using state_type = details::when_any_state<done_type, void>;
+
+            if (ops.empty()) {
+                done(make_error_code(std::errc::no_child_process));
+                return;
+            }
+
+            auto state = std::make_shared<state_type>(std::move(done), ops.size());
+            for (auto& op : ops) {
+                op(details::make_op_callback<void>([state](std::error_code ec) { state->on_completed(ec); }));
+            }
+        }
+    };
+}
+
+// Completes as soon as k operations succeeded, or as soon as so many failed that k successes are not possible anymore
+// (with the error of the operation that made it impossible). Operation is called as op(token, done) and can hook its
+// cancellation into token.impl, operations still running at completion get cancelled. Results are (index, result) of
+// successful operations in order of completion. k greater than number of operations completes with
+// std::errc::invalid_argument without starting any:
+//
+//   when_k(2, std::move(replica_reads))([](std::error_code ec, std::vector<std::pair<std::size_t, T>> results) {});
+//
+// Like with other combinators completions have to be serialized: replica reads completing on a thread pool should
+// call their done through a strand (e.g. asio::post(strand, ...)), otherwise counting of the quorum races.
+template <class Op>
+auto when_k(std::size_t k, std::vector<Op> ops) {
+    return [k, ops = std::move(ops)](auto done) mutable {
+        using done_type = decltype(done);
+
+        if constexpr (details::has_results_v<done_type>) {
+            using results_type = utils::result_type_t<done_type>;
+            using result_type = typename results_type::value_type::second_type;
+            using state_type = details::when_k_state<done_type, results_type>;
+
+            if (k > ops.size()) {
+                done(make_error_code(std::errc::invalid_argument), results_type{});
+                return;
+            }
+            if (k == 0) {
+                done(std::error_code(), results_type{});
+                return;
+            }
+
+            auto state = std::make_shared<state_type>(std::move(done), ops.size(), k);
+            // operations completing inline may reach the quorum before the rest is even started.
+            for (std::size_t i = 0; i < ops.size() && state->done; ++i) {
+                ops[i](state->tokens[i],
+                       details::make_op_callback<result_type>([state, i](std::error_code ec, result_type r) {
+                           state->on_completed(i, ec, std::move(r));
+                       }));
+            }
+        } else {
+            using state_type = details::when_k_state<done_type, void>;
+
+            if (k > ops.size()) {
+                done(make_error_code(std::errc::invalid_argument));
+                return;
+            }
+            if (k == 0) {
+                done(std::error_code());
+                return;
+            }
+
+            auto state = std::make_shared<state_type>(std::move(done), ops.size(), k);
+            for (std::size_t i = 0; i < ops.size() && state->done; ++i) {
+                ops[i](state->tokens[i], details::make_op_callback<void>([state, i](std::error_code ec) {
+                           state->on_completed(i, ec);
+                       }));
+            }
+        }
+    };
+}
+
+}  // namespace lsem::async
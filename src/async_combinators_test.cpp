@@ -0,0 +1,321 @@
+#include "async_combinators.hpp"
+
+#include <asio/io_context.hpp>
+#include <asio/post.hpp>
+#include <asio/steady_timer.hpp>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <variant>
+#include <vector>
+
+using namespace lsem::async;
+using namespace std::chrono_literals;
+
+namespace {
+auto make_op(asio::io_context& ctx, std::error_code ec, int r) {
+    return [&ctx, ec, r](auto done) { asio::post(ctx, [done = std::move(done), ec, r]() mutable { done(ec, r); }); };
+}
+}  // namespace
+
+TEST(when_all_tests, fixed__all_succeeded) {
+    asio::io_context ctx;
+
+    auto string_op = [&ctx](auto done) {
+        asio::post(ctx, [done = std::move(done)]() mutable { done(std::error_code(), std::string("hello")); });
+    };
+
+    std::optional<std::tuple<std::error_code, std::tuple<int, std::string>>> actual_result;
+    when_all(make_op(ctx, {}, 42), string_op)([&](std::error_code ec, std::tuple<int, std::string> results) {
+        actual_result = std::tuple{ec, std::move(results)};
+    });
+
+    ctx.run();
+    EXPECT_EQ(actual_result, (std::tuple{std::error_code(), std::tuple{42, std::string("hello")}}));
+}
+
+TEST(when_all_tests, fixed__first_error_reported_after_all_completed) {
+    asio::io_context ctx;
+
+    int completed = 0;
+    auto counted_op = [&ctx, &completed](auto done) {
+        asio::post(ctx, [done = std::move(done), &completed]() mutable {
+            completed++;
+            done(std::error_code(), 1);
+        });
+    };
+
+    std::optional<std::tuple<std::error_code, std::tuple<int, int, int>>> actual_result;
+    auto all = when_all(make_op(ctx, make_error_code(std::errc::io_error), 1),
+                        make_op(ctx, make_error_code(std::errc::timed_out), 2), counted_op);
+    all([&](std::error_code ec, std::tuple<int, int, int> results) {
+        EXPECT_EQ(completed, 1);
+        actual_result = std::tuple{ec, results};
+    });
+
+    ctx.run();
+    EXPECT_EQ(actual_result, (std::tuple{make_error_code(std::errc::io_error), std::tuple{0, 0, 1}}));
+}
+
+TEST(when_all_tests, fixed__no_results) {
+    asio::io_context ctx;
+
+    int called_times = 0;
+    auto op = [&called_times](auto done) {
+        called_times++;
+        done(std::error_code());
+    };
+
+    std::optional<std::error_code> actual_result;
+    when_all(op, op, op)([&](std::error_code ec) { actual_result = ec; });
+
+    ctx.run();
+    EXPECT_EQ(actual_result, std::error_code());
+    EXPECT_EQ(called_times, 3);
+}
+
+TEST(when_all_tests, dropped_callback_reported_as_not_called) {
+    asio::io_context ctx;
+
+    auto dropping_op = [](auto done) {};
+
+    std::optional<std::tuple<std::error_code, std::tuple<int, int>>> actual_result;
+    when_all(make_op(ctx, {}, 1), dropping_op)([&](std::error_code ec, std::tuple<int, int> results) {
+        actual_result = std::tuple{ec, results};
+    });
+
+    ctx.run();
+    EXPECT_EQ(actual_result, (std::tuple{make_error_code(lsem::async_kit::errors::async_callback_err::not_called),
+                                         std::tuple{1, 0}}));
+}
+
+TEST(when_all_tests, dynamic__results_in_order) {
+    asio::io_context ctx;
+
+    using op_type = decltype(make_op(ctx, {}, 0));
+    std::vector<op_type> ops;
+    for (int i = 0; i < 5; ++i) {
+        ops.push_back(make_op(ctx, {}, i * 10));
+    }
+
+    std::optional<std::tuple<std::error_code, std::vector<int>>> actual_result;
+    when_all(std::move(ops))([&](std::error_code ec, std::vector<int> results) {
+        actual_result = std::tuple{ec, std::move(results)};
+    });
+
+    ctx.run();
+    EXPECT_EQ(actual_result, (std::tuple{std::error_code(), std::vector{0, 10, 20, 30, 40}}));
+}
+
+TEST(when_all_tests, dynamic__empty) {
+    asio::io_context ctx;
+
+    std::vector<decltype(make_op(ctx, {}, 0))> ops;
+
+    std::optional<std::tuple<std::error_code, std::vector<int>>> actual_result;
+    when_all(std::move(ops))([&](std::error_code ec, std::vector<int> results) {
+        actual_result = std::tuple{ec, std::move(results)};
+    });
+
+    EXPECT_EQ(actual_result, (std::tuple{std::error_code(), std::vector<int>{}}));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+TEST(when_any_tests, fixed__first_success_wins) {
+    asio::io_context ctx;
+
+    auto string_op = [&ctx](auto done) {
+        asio::post(ctx, [done = std::move(done)]() mutable { done(std::error_code(), std::string("hello")); });
+    };
+
+    std::optional<std::tuple<std::error_code, std::variant<int, std::string>>> actual_result;
+    int called_times = 0;
+    when_any(make_op(ctx, make_error_code(std::errc::io_error), 1),
+             string_op)([&](std::error_code ec, std::variant<int, std::string> first) {
+        called_times++;
+        actual_result = std::tuple{ec, std::move(first)};
+    });
+
+    ctx.run();
+    ASSERT_TRUE(actual_result.has_value());
+    EXPECT_EQ(std::get<0>(*actual_result), std::error_code());
+    EXPECT_EQ(std::get<1>(*actual_result).index(), 1);
+    EXPECT_EQ(std::get<std::string>(std::get<1>(*actual_result)), "hello");
+    EXPECT_EQ(called_times, 1);
+}
+
+TEST(when_any_tests, fixed__late_results_dropped) {
+    asio::io_context ctx;
+
+    std::vector<std::variant<int, int>> results;
+    when_any(make_op(ctx, {}, 1), make_op(ctx, {}, 2))(
+        [&](std::error_code ec, std::variant<int, int> first) { results.push_back(first); });
+
+    ctx.run();
+    ASSERT_EQ(results.size(), 1);
+    EXPECT_EQ(results[0].index(), 0);
+}
+
+TEST(when_any_tests, fixed__all_failed_reports_last_error) {
+    asio::io_context ctx;
+
+    auto failing_op = [&ctx](std::error_code ec) {
+        return [&ctx, ec](auto done) { asio::post(ctx, [done = std::move(done), ec]() mutable { done(ec); }); };
+    };
+
+    std::optional<std::error_code> actual_result;
+    when_any(failing_op(make_error_code(std::errc::io_error)), failing_op(make_error_code(std::errc::timed_out)))(
+        [&](std::error_code ec) { actual_result = ec; });
+
+    ctx.run();
+    EXPECT_EQ(actual_result, make_error_code(std::errc::timed_out));
+}
+
+TEST(when_any_tests, dynamic__index_of_winner_reported) {
+    asio::io_context ctx;
+
+    std::vector<decltype(make_op(ctx, {}, 0))> ops;
+    ops.push_back(make_op(ctx, make_error_code(std::errc::io_error), 0));
+    ops.push_back(make_op(ctx, {}, 10));
+    ops.push_back(make_op(ctx, {}, 20));
+
+    std::optional<std::tuple<std::error_code, std::pair<std::size_t, int>>> actual_result;
+    when_any(std::move(ops))([&](std::error_code ec, std::pair<std::size_t, int> first) {
+        actual_result = std::tuple{ec, first};
+    });
+
+    ctx.run();
+    EXPECT_EQ(actual_result, (std::tuple{std::error_code(), std::pair<std::size_t, int>{1, 10}}));
+}
+
+TEST(when_any_tests, dynamic__empty) {
+    asio::io_context ctx;
+
+    std::vector<decltype(make_op(ctx, {}, 0))> ops;
+
+    std::optional<std::error_code> actual_result;
+    when_any(std::move(ops))([&](std::error_code ec, std::pair<std::size_t, int>) { actual_result = ec; });
+
+    EXPECT_EQ(actual_result, make_error_code(std::errc::no_child_process));
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+namespace {
+// replica read which completes after given delay unless cancelled.
+auto make_replica(asio::io_context& ctx, std::chrono::milliseconds delay, std::error_code ec, int r, int& cancelled) {
+    return [&ctx, delay, ec, r, &cancelled](cancellation_token& token, auto done) {
+        auto timer = std::make_shared<asio::steady_timer>(ctx, delay);
+        token.impl = [timer, &cancelled] {
+            cancelled++;
+            timer->cancel();
+        };
+        timer->async_wait([timer, done = std::move(done), ec, r](std::error_code timer_ec) mutable {
+            done(timer_ec ? timer_ec : ec, r);
+        });
+    };
+}
+}  // namespace
+
+TEST(when_k_tests, completes_on_quorum_and_cancels_stragglers) {
+    asio::io_context ctx;
+
+    int cancelled = 0;
+    std::vector<decltype(make_replica(ctx, 0ms, {}, 0, cancelled))> ops;
+    ops.push_back(make_replica(ctx, 10ms, {}, 1, cancelled));
+    ops.push_back(make_replica(ctx, 10s, {}, 2, cancelled));
+    ops.push_back(make_replica(ctx, 20ms, {}, 3, cancelled));
+
+    std::optional<std::tuple<std::error_code, std::vector<std::pair<std::size_t, int>>>> actual_result;
+    auto start_time = std::chrono::steady_clock::now();
+    when_k(2, std::move(ops))([&](std::error_code ec, std::vector<std::pair<std::size_t, int>> results) {
+        actual_result = std::tuple{ec, std::move(results)};
+    });
+
+    ctx.run();
+    using results_type = std::vector<std::pair<std::size_t, int>>;
+    EXPECT_EQ(actual_result, (std::tuple{std::error_code(), results_type{{0, 1}, {2, 3}}}));
+    EXPECT_EQ(cancelled, 1);
+    EXPECT_LT(std::chrono::steady_clock::now() - start_time, 1s);
+}
+
+TEST(when_k_tests, fails_once_quorum_impossible) {
+    asio::io_context ctx;
+
+    int cancelled = 0;
+    std::vector<decltype(make_replica(ctx, 0ms, {}, 0, cancelled))> ops;
+    ops.push_back(make_replica(ctx, 10ms, make_error_code(std::errc::io_error), 0, cancelled));
+    ops.push_back(make_replica(ctx, 20ms, make_error_code(std::errc::timed_out), 0, cancelled));
+    ops.push_back(make_replica(ctx, 10s, {}, 3, cancelled));
+
+    std::optional<std::tuple<std::error_code, std::vector<std::pair<std::size_t, int>>>> actual_result;
+    when_k(2, std::move(ops))([&](std::error_code ec, std::vector<std::pair<std::size_t, int>> results) {
+        actual_result = std::tuple{ec, std::move(results)};
+    });
+
+    ctx.run();
+    using results_type = std::vector<std::pair<std::size_t, int>>;
+    EXPECT_EQ(actual_result, (std::tuple{make_error_code(std::errc::timed_out), results_type{}}));
+    EXPECT_EQ(cancelled, 1);
+}
+
+TEST(when_k_tests, inline_quorum_does_not_start_rest) {
+    asio::io_context ctx;
+
+    int started = 0;
+    auto op = [&started](cancellation_token&, auto done) {
+        started++;
+        done(std::error_code(), started);
+    };
+    std::vector<decltype(op)> ops(4, op);
+
+    std::optional<std::tuple<std::error_code, std::vector<std::pair<std::size_t, int>>>> actual_result;
+    when_k(2, std::move(ops))([&](std::error_code ec, std::vector<std::pair<std::size_t, int>> results) {
+        actual_result = std::tuple{ec, std::move(results)};
+    });
+
+    using results_type = std::vector<std::pair<std::size_t, int>>;
+    EXPECT_EQ(actual_result, (std::tuple{std::error_code(), results_type{{0, 1}, {1, 2}}}));
+    EXPECT_EQ(started, 2);
+}
+
+TEST(when_k_tests, no_results) {
+    auto op = [](cancellation_token&, auto done) { done(std::error_code()); };
+
+    std::optional<std::error_code> actual_result;
+    when_k(1, std::vector{op, op})([&](std::error_code ec) { actual_result = ec; });
+
+    EXPECT_EQ(actual_result, std::error_code());
+}
+
+TEST(when_k_tests, k_greater_than_number_of_operations) {
+    int started = 0;
+    auto op = [&](cancellation_token&, auto done) {
+        started++;
+        done(std::error_code(), 1);
+    };
+    auto op_no_result = [&](cancellation_token&, auto done) {
+        started++;
+        done(std::error_code());
+    };
+
+    std::optional<std::tuple<std::error_code, std::vector<std::pair<std::size_t, int>>>> actual_result;
+    when_k(2, std::vector{op})([&](std::error_code ec, std::vector<std::pair<std::size_t, int>> results) {
+        actual_result = std::tuple{ec, std::move(results)};
+    });
+    std::optional<std::error_code> actual_result_no_result;
+    when_k(3, std::vector{op_no_result, op_no_result})([&](std::error_code ec) { actual_result_no_result = ec; });
+
+    using results_type = std::vector<std::pair<std::size_t, int>>;
+    EXPECT_EQ(actual_result, (std::tuple{make_error_code(std::errc::invalid_argument), results_type{}}));
+    EXPECT_EQ(actual_result_no_result, make_error_code(std::errc::invalid_argument));
+    EXPECT_EQ(started, 0);
+}
@@ -0,0 +1,156 @@
+#pragma once
+
+#include "async_combinators.hpp"
+#include "cancellation_token.hpp"
+#include "utils.hpp"
+
+#include <asio/io_context.hpp>
+#include <asio/steady_timer.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <system_error>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace lsem::async {
+
+namespace details {
+
+template <class AsyncFunction, class Done, class Args, class Result>
+struct hedge_control_block
+    : public std::enable_shared_from_this<hedge_control_block<AsyncFunction, Done, Args, Result>> {
+    hedge_control_block(AsyncFunction f,
+                        Done done,
+                        Args args,
+                        asio::steady_timer hedge_timer,
+                        std::chrono::steady_clock::duration delay,
+                        std::size_t attempts)
+        : f(std::move(f)),
+          done(std::move(done)),
+          args(std::move(args)),
+          hedge_timer(std::move(hedge_timer)),
+          delay(delay),
+          tokens(attempts) {}
+
+    void start_next() {
+        const std::size_t i = started++;
+        pending++;
+        if (started < tokens.size()) {
+            // rearming cancels wait of the previous hedge, if any.
+            hedge_timer.expires_after(delay);
+            hedge_timer.async_wait([self = this->shared_from_this()](std::error_code ec) {
+                if (!ec && self->done) {
+                    self->start_next();
+                }
+            });
+        }
+
+        std::apply(
+            [this, i](auto&... input) {
+                auto self = this->shared_from_this();
+                if constexpr (std::is_void_v<Result>) {
+                    f(tokens[i], input..., make_op_callback<void>([self, i](std::error_code ec) {
+                          self->on_completed(i, ec);
+                      }));
+                } else {
+                    f(tokens[i], input..., make_op_callback<Result>([self, i](std::error_code ec, Result r) {
+                          self->on_completed(i, ec, std::move(r));
+                      }));
+                }
+            },
+            args);
+    }
+
+    template <class... R>
+    void on_completed(std::size_t i, std::error_code ec, R&&... r) {
+        pending--;
+        if (!cancelling) {
+            tokens[i].impl = nullptr;
+        }
+        if (!done) {
+            // lost the race, result is dropped.
+            return;
+        }
+        if (!ec) {
+            complete(ec, std::forward<R>(r)...);
+        } else if (pending == 0) {
+            if (started == tokens.size()) {
+                if constexpr (std::is_void_v<Result>) {
+                    complete(ec);
+                } else {
+                    complete(ec, Result{});
+                }
+            } else {
+                // nothing in flight, no point in waiting for the delay.
+                start_next();
+            }
+        }
+    }
+
+    template <class... R>
+    void complete(std::error_code ec, R&&... r) {
+        auto done_cb = std::exchange(done, std::nullopt).value();
+        hedge_timer.cancel();
+        cancelling = true;
+        for (auto& token : tokens) {
+            token.cancel();
+        }
+        cancelling = false;
+        done_cb(ec, std::forward<R>(r)...);
+    }
+
+    AsyncFunction f;
+    std::optional<Done> done;
+    Args args;
+    asio::steady_timer hedge_timer;
+    const std::chrono::steady_clock::duration delay;
+    std::vector<cancellation_token> tokens;
+    std::size_t started = 0;
+    std::size_t pending = 0;
+    bool cancelling = false;
+};
+
+}  // namespace details
+
+// Hedged calls of idempotent async function. Calls f, and if no reply arrived after delay, launches one more attempt
+// in parallel, up to max_hedges extra attempts. Completes with the first successful result, attempts still in flight
+// get cancelled. Failed attempt with nothing else in flight launches next one immediately. When every attempt failed,
+// completes with the last error.
+//
+// f is called as f(token, args..., done) and can hook its cancellation into token.impl. Unlike async_retry, args are
+// kept by value since they are needed for attempts started after the call returned.
+template <class AsyncFunction>
+auto async_hedge(asio::io_context& ctx,
+                 AsyncFunction f,
+                 std::chrono::steady_clock::duration delay,
+                 unsigned max_hedges = 1) {
+    return [&ctx, f = std::move(f), delay, max_hedges](auto&&... args) {
+        auto args_as_tuple = std::forward_as_tuple(std::forward<decltype(args)>(args)...);
+        auto done = std::get<sizeof...(args) - 1>(std::move(args_as_tuple));
+
+        auto input_args = [&]<std::size_t... I>(std::index_sequence<I...>) {
+            using args_type = std::tuple<decltype(args)...>;
+            return std::tuple<std::decay_t<std::tuple_element_t<I, args_type>>...>(
+                std::get<I>(std::move(args_as_tuple))...);
+        }(std::make_index_sequence<sizeof...(args) - 1>{});
+
+        static_assert(std::is_invocable_v<decltype(done), std::error_code> ||
+                          std::is_invocable_v<decltype(done), std::error_code, utils::default_val&>,
+                      "last argument expected to be callback");
+
+        using result_type = utils::result_type_t<decltype(done)>;
+        using control_block_type =
+            details::hedge_control_block<AsyncFunction, decltype(done), decltype(input_args), result_type>;
+
+        auto shared_control_block = std::make_shared<control_block_type>(
+            f, std::move(done), std::move(input_args), asio::steady_timer{ctx}, delay, max_hedges + 1);
+        shared_control_block->start_next();
+    };
+}
+
+}  // namespace lsem::async
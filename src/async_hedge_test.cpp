@@ -0,0 +1,125 @@
+#include "async_hedge.hpp"
+
+#include <asio/io_context.hpp>
+#include <asio/post.hpp>
+#include <asio/steady_timer.hpp>
+
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <tuple>
+#include <vector>
+
+using namespace std::chrono_literals;
+using namespace lsem::async;
+
+namespace {
+// replies with attempt number after latency of given attempt, cancellable through the token.
+struct fake_replica {
+    asio::io_context& ctx;
+    std::vector<std::chrono::milliseconds> latencies;
+    std::vector<std::error_code> errors;
+    int started = 0;
+    int cancelled = 0;
+
+    auto op() {
+        return [this](cancellation_token& token, int arg, auto done) {
+            const auto attempt = started++;
+            auto timer = std::make_shared<asio::steady_timer>(ctx, latencies[attempt]);
+            token.impl = [this, timer] {
+                cancelled++;
+                timer->cancel();
+            };
+            timer->async_wait([timer, done = std::move(done), ec = errors[attempt], r = arg + attempt](
+                                  std::error_code timer_ec) mutable { done(timer_ec ? timer_ec : ec, r); });
+        };
+    }
+};
+}  // namespace
+
+TEST(async_hedge_tests, fast_reply_no_hedge) {
+    asio::io_context ctx;
+    fake_replica replica{ctx, {10ms, 10ms}, {{}, {}}};
+
+    std::optional<std::tuple<std::error_code, int>> actual_result;
+    async_hedge(ctx, replica.op(), 100ms)(100, [&](std::error_code ec, int r) { actual_result = std::tuple{ec, r}; });
+
+    ctx.run();
+    EXPECT_EQ(actual_result, (std::tuple{std::error_code(), 100}));
+    EXPECT_EQ(replica.started, 1);
+    EXPECT_EQ(replica.cancelled, 0);
+}
+
+TEST(async_hedge_tests, slow_reply_hedged_and_cancelled) {
+    asio::io_context ctx;
+    fake_replica replica{ctx, {10s, 10ms}, {{}, {}}};
+
+    std::optional<std::tuple<std::error_code, int>> actual_result;
+    auto start_time = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::duration time_taken;
+    async_hedge(ctx, replica.op(), 20ms)(100, [&](std::error_code ec, int r) {
+        actual_result = std::tuple{ec, r};
+        time_taken = std::chrono::steady_clock::now() - start_time;
+    });
+
+    ctx.run();
+    EXPECT_EQ(actual_result, (std::tuple{std::error_code(), 101}));
+    EXPECT_EQ(replica.started, 2);
+    EXPECT_EQ(replica.cancelled, 1);
+    EXPECT_NEAR(std::chrono::duration_cast<std::chrono::milliseconds>(time_taken).count(), 30, 15);
+}
+
+TEST(async_hedge_tests, failure_launches_next_attempt_immediately) {
+    asio::io_context ctx;
+    fake_replica replica{ctx, {1ms, 1ms, 1ms}, {make_error_code(std::errc::io_error), {}, {}}};
+
+    std::optional<std::tuple<std::error_code, int>> actual_result;
+    auto start_time = std::chrono::steady_clock::now();
+    async_hedge(ctx, replica.op(), 10s, 2)(100, [&](std::error_code ec, int r) { actual_result = std::tuple{ec, r}; });
+
+    ctx.run();
+    EXPECT_EQ(actual_result, (std::tuple{std::error_code(), 101}));
+    EXPECT_EQ(replica.started, 2);
+    EXPECT_LT(std::chrono::steady_clock::now() - start_time, 1s);
+}
+
+TEST(async_hedge_tests, all_failed_reports_last_error) {
+    asio::io_context ctx;
+    fake_replica replica{ctx,
+                         {1ms, 1ms},
+                         {make_error_code(std::errc::io_error), make_error_code(std::errc::connection_refused)}};
+
+    std::optional<std::tuple<std::error_code, int>> actual_result;
+    async_hedge(ctx, replica.op(), 10s)(100, [&](std::error_code ec, int r) { actual_result = std::tuple{ec, r}; });
+
+    ctx.run();
+    EXPECT_EQ(actual_result, (std::tuple{make_error_code(std::errc::connection_refused), 0}));
+    EXPECT_EQ(replica.started, 2);
+}
+
+TEST(async_hedge_tests, args_kept_for_hedges__no_result) {
+    asio::io_context ctx;
+
+    int started = 0;
+    auto op = [&ctx, &started](cancellation_token&, const std::unique_ptr<int>& arg, auto done) {
+        started++;
+        auto timer = std::make_shared<asio::steady_timer>(ctx, started == 1 ? 10s : 1ms);
+        timer->async_wait([timer, done = std::move(done), ok = *arg == 42](std::error_code) mutable {
+            done(ok ? std::error_code() : make_error_code(std::errc::invalid_argument));
+        });
+    };
+
+    std::optional<std::error_code> actual_result;
+    auto hedged = async_hedge(ctx, op, 5ms);
+    {
+        auto arg = std::make_unique<int>(42);
+        hedged(std::move(arg), [&](std::error_code ec) { actual_result = ec; });
+    }
+
+    ctx.run_for(1s);
+    EXPECT_EQ(actual_result, std::error_code());
+    EXPECT_EQ(started, 2);
+}
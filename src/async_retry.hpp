@@ -1,3 +1,10 @@
+#pragma once
+
+#include "async_timeoutable.hpp"
+#include "cancellation_token.hpp"
+#include "deadline.hpp"
+#include "pooled_allocator.hpp"
+#include "timer_coalescer.hpp"
 #include "utils.hpp"
 
 #include <asio/io_context.hpp>
@@ -5,7 +12,16 @@
 #include <asio/steady_timer.hpp>
 
 #include <function2/function2.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
 #include <iostream>
+#include <memory>
+#include <optional>
+#include <random>
 
 namespace lsem::async {
 
@@ -17,89 +33,347 @@ void async_sleep(asio::io_context& ctx, std::chrono::steady_clock::duration t, C
     timer->async_wait([timer, cb = std::move(cb)](std::error_code ec) { cb(ec); });
 }
 
+// How pause between attempts changes from one retry to the next. Everything except fixed is capped by max_pause.
+//   fixed: pause every time.
+//   exponential: pause * multiplier^retry.
+//   full_jitter: random in [0, pause * multiplier^retry].
+//   decorrelated_jitter: random in [pause, previous pause * 3], previous pause being pause for the first retry.
+// Jittered variants keep many instances that failed at the same moment from retrying in lockstep.
+enum class backoff_kind { fixed, exponential, full_jitter, decorrelated_jitter };
+
+// Token bucket limiting retries of many async_retry instances sharing it, e.g. to 10% of successful calls. Every
+// successful call deposits ratio tokens, every retry withdraws one token, and once there are no tokens retries fail
+// fast with the error of the last attempt. Bucket starts full and never holds more than max_tokens, so short bursts
+// of failures are still retried. Safe to share between threads.
+class retry_budget {
+   public:
+    explicit retry_budget(double ratio = 0.1, unsigned max_tokens = 10)
+        : m_deposit(static_cast<std::int64_t>(ratio * scale)),
+          m_max(static_cast<std::int64_t>(max_tokens) * scale),
+          m_tokens(m_max) {}
+
+    void deposit() {
+        auto tokens = m_tokens.load(std::memory_order_relaxed);
+        while (tokens < m_max) {
+            if (m_tokens.compare_exchange_weak(tokens, std::min(m_max, tokens + m_deposit), std::memory_order_relaxed)) {
+                return;
+            }
+        }
+    }
+
+    bool try_withdraw() {
+        auto tokens = m_tokens.load(std::memory_order_relaxed);
+        while (tokens >= scale) {
+            if (m_tokens.compare_exchange_weak(tokens, tokens - scale, std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    double tokens() const { return static_cast<double>(m_tokens.load(std::memory_order_relaxed)) / scale; }
+
+   private:
+    // fixed point, so fractional deposits are counted exactly.
+    static constexpr std::int64_t scale = 1000;
+    const std::int64_t m_deposit;
+    const std::int64_t m_max;
+    std::atomic<std::int64_t> m_tokens;
+};
+
 struct async_retry_opts {
     unsigned attempts = 3u;
     std::chrono::steady_clock::duration pause = 1s;
+    backoff_kind backoff = backoff_kind::fixed;
+    double multiplier = 2.0;
+    std::chrono::steady_clock::duration max_pause = 30s;
+    std::shared_ptr<retry_budget> budget;
+    // zero means attempt may take as long as it wants. Attempt that did not complete in time is treated as failed
+    // with std::errc::timed_out, its late completion is ignored.
+    std::chrono::steady_clock::duration attempt_timeout = 0s;
+    // when set, pauses are armed in coalescer, which has to run on the same io_context, and may last up to
+    // coalescer->slack() longer. Many instances pausing at about the same time then share wakeups.
+    std::shared_ptr<timer_coalescer> pause_coalescer;
+    // all attempts and pauses have to fit before it. Attempt in flight is timed out when it passes (as with
+    // attempt_timeout, whichever comes first), and no retry is made when pause alone would not end before it. Call
+    // made when it has already passed fails with std::errc::timed_out without any attempt.
+    lsem::async::deadline deadline;
+};
+
+// Default retryable predicate: every error is worth another attempt.
+struct retry_any_error {
+    bool operator()(std::error_code) const { return true; }
+};
+
+// Retries only errors that are likely to go away by themselves: timeouts, refused/reset connections, busy resources.
+// Everything else (invalid argument, permission denied, not found, ...) fails on the first attempt.
+struct retry_transient_errors {
+    bool operator()(std::error_code ec) const {
+        if (ec == asio::error::operation_aborted) {
+            return false;
+        }
+        return ec == std::errc::timed_out || ec == std::errc::resource_unavailable_try_again ||
+               ec == std::errc::interrupted || ec == std::errc::device_or_resource_busy ||
+               ec == std::errc::io_error || ec == std::errc::connection_refused ||
+               ec == std::errc::connection_reset || ec == std::errc::connection_aborted ||
+               ec == std::errc::network_unreachable || ec == std::errc::network_down ||
+               ec == std::errc::host_unreachable || ec == std::errc::broken_pipe;
+    }
 };
 
 namespace details {
 
+inline std::chrono::steady_clock::duration random_duration(std::chrono::steady_clock::duration from,
+                                                           std::chrono::steady_clock::duration to) {
+    thread_local std::minstd_rand engine{std::random_device{}()};
+    if (to <= from) {
+        return from;
+    }
+    using rep = std::chrono::steady_clock::duration::rep;
+    return std::chrono::steady_clock::duration{std::uniform_int_distribution<rep>{from.count(), to.count()}(engine)};
+}
+
+// Pause before retry number `retry` (0 for the first retry). prev_pause is state of decorrelated jitter.
+inline std::chrono::steady_clock::duration next_pause(const async_retry_opts& opts,
+                                                      unsigned retry,
+                                                      std::chrono::steady_clock::duration& prev_pause) {
+    using duration = std::chrono::steady_clock::duration;
+
+    const auto exponential = [&] {
+        const double pause = static_cast<double>(opts.pause.count()) * std::pow(opts.multiplier, retry);
+        return pause >= static_cast<double>(opts.max_pause.count()) ? opts.max_pause
+                                                                    : duration{static_cast<duration::rep>(pause)};
+    };
+
+    switch (opts.backoff) {
+        case backoff_kind::fixed:
+            return opts.pause;
+        case backoff_kind::exponential:
+            return exponential();
+        case backoff_kind::full_jitter:
+            return random_duration(duration::zero(), exponential());
+        case backoff_kind::decorrelated_jitter: {
+            // first retry is already spread over [pause, pause * 3].
+            const auto upper = (prev_pause == duration::zero() ? opts.pause : prev_pause) * 3;
+            prev_pause = std::min(opts.max_pause, random_duration(opts.pause, upper));
+            return prev_pause;
+        }
+    }
+    return opts.pause;
+}
+
+template <class Retryable, class... Ts>
+bool is_retryable(Retryable& retryable, std::error_code ec, const Ts&... r) {
+    if constexpr (std::is_invocable_r_v<bool, Retryable&, std::error_code, const Ts&...>) {
+        return retryable(ec, r...);
+    } else {
+        static_assert(std::is_invocable_r_v<bool, Retryable&, std::error_code>,
+                      "retryable expected to be bool(error_code) or bool(error_code, const Ts&...)");
+        return retryable(ec);
+    }
+}
+
+// Retry state shared by attempts of a single call. Ts... are values passed to done after error_code, empty for
+// void(std::error_code) callbacks.
+template <class... Ts>
 struct control_block {
-    int attempt = 1;
+    unsigned attempt = 1;
     const async_retry_opts opts;
 
-    using callback_type = fu2::unique_function<void(std::error_code)>;
+    using callback_type = fu2::unique_function<void(std::error_code, Ts...)>;
     using thunk_type = fu2::unique_function<void()>;
 
     explicit control_block(async_retry_opts opts, asio::steady_timer pause_timer)
-        : opts(std::move(opts)), pause_timer(std::move(pause_timer)) {}
+        : opts(std::move(opts)),
+          pause_timer(std::move(pause_timer)),
+          attempt_deadline(asio::steady_timer{this->pause_timer.get_executor()}) {
+        if (this->opts.pause_coalescer) {
+            coalesced_pause_timer.emplace(*this->opts.pause_coalescer);
+        }
+    }
 
-    void cancel() { pause_timer.cancel(); }
+    void cancel() {
+        pause_timer.cancel();
+        if (coalesced_pause_timer) {
+            coalesced_pause_timer->cancel();
+        }
+    }
 
-    thunk_type try_next;
-    callback_type custom_handler;
-    std::shared_ptr<fu2::unique_function<void()>> real_cancel;
-    asio::steady_timer pause_timer;
-};
+    template <class Handler>
+    void async_pause(std::chrono::steady_clock::duration pause, Handler&& handler) {
+        if (coalesced_pause_timer) {
+            coalesced_pause_timer->expires_after(pause);
+            coalesced_pause_timer->async_wait(std::forward<Handler>(handler));
+        } else {
+            pause_timer.expires_after(pause);
+            pause_timer.async_wait(std::forward<Handler>(handler));
+        }
+    }
 
-template <class R>
-struct control_block_with_result {
-    using callback_type = fu2::unique_function<void(std::error_code, R)>;
-    using thunk_type = fu2::unique_function<void()>;
+    // attempt was already advanced to the one after pause.
+    std::chrono::steady_clock::duration pause_before_next() { return next_pause(opts, attempt - 2, prev_pause); }
 
-    explicit control_block_with_result(async_retry_opts opts, asio::steady_timer pause_timer)
-        : opts(std::move(opts)), pause_timer(std::move(pause_timer)) {}
+    bool budget_allows_retry() { return !opts.budget || opts.budget->try_withdraw(); }
 
-    void cancel() { pause_timer.cancel(); }
+    // zero when attempt may take as long as it wants.
+    std::chrono::steady_clock::duration attempt_timeout() const {
+        if (opts.deadline.unbounded()) {
+            return opts.attempt_timeout;
+        }
+        // deadline passing right now still has to time attempt out.
+        const auto left = std::max(opts.deadline.remaining(), std::chrono::steady_clock::duration(1));
+        return opts.attempt_timeout > std::chrono::steady_clock::duration::zero() ? std::min(opts.attempt_timeout, left)
+                                                                                  : left;
+    }
+
+    // Starts timeout of the current attempt, if any, and returns attempt number its completion has to report.
+    template <class OnTimeout>
+    unsigned arm_attempt_timeout(OnTimeout on_timeout) {
+        attempt_deadline.reset();
+        if (const auto timeout = attempt_timeout(); timeout > std::chrono::steady_clock::duration::zero()) {
+            attempt_deadline.timeout_timer.expires_after(timeout);
+            attempt_deadline.timeout_timer.async_wait(
+                [this, attempt = attempt, on_timeout = std::move(on_timeout)](std::error_code ec) mutable {
+                    if (!ec && this->attempt == attempt && attempt_deadline.try_finish(control_block_t::timed_out)) {
+                        on_timeout();
+                    }
+                });
+        }
+        return attempt;
+    }
+
+    // false for completion of an attempt that already timed out.
+    bool attempt_completed(unsigned completed_attempt) {
+        if (completed_attempt != attempt || !attempt_deadline.try_finish(control_block_t::completed)) {
+            return false;
+        }
+        attempt_deadline.timeout_timer.cancel();
+        return true;
+    }
+
+    void on_success() {
+        if (opts.budget) {
+            opts.budget->deposit();
+        }
+    }
 
-    int attempt = 1;
-    const async_retry_opts opts;
     thunk_type try_next;
     callback_type custom_handler;
     std::shared_ptr<fu2::unique_function<void()>> real_cancel;
     asio::steady_timer pause_timer;
+    std::optional<coalesced_timer> coalesced_pause_timer;
+    // timeout of the attempt in flight, flags reset by each attempt.
+    control_block_t attempt_deadline;
+    std::chrono::steady_clock::duration prev_pause{};
 };
-}  // namespace details
 
-// token is a thing that allow to cancel async operation.
-struct cancellation_token {
-    ~cancellation_token() {
-        if (impl) {
-            impl();
-        }
+template <class Allocator, class AsyncFunction, class Retryable, class Done, class InputArgs, class... Ts>
+void start_retry(std::type_identity<std::tuple<Ts...>>,
+                 asio::io_context& ctx,
+                 const AsyncFunction& f,
+                 async_retry_opts opts,
+                 const Retryable& retryable,
+                 const std::shared_ptr<fu2::unique_function<void()>>& real_cancel,
+                 Done done,
+                 InputArgs input_args) {
+    using control_block_type = control_block<Ts...>;
+
+    if (opts.deadline.expired()) {
+        done(make_error_code(std::errc::timed_out), Ts{}...);
+        return;
     }
 
-    void cancel() {
-        if (impl) {
-            impl();
-            impl = nullptr;
-        }
-    }
+    auto shared_control_block =
+        std::allocate_shared<control_block_type>(Allocator{}, std::move(opts), asio::steady_timer{ctx});
+
+    *real_cancel = [shared_control_block]() { shared_control_block->cancel(); };
+    shared_control_block->real_cancel = real_cancel;
+
+    shared_control_block->try_next = [shared_control_block, f, input_args = std::move(input_args)]() {
+        const unsigned attempt = shared_control_block->arm_attempt_timeout([shared_control_block] {
+            shared_control_block->custom_handler(make_error_code(std::errc::timed_out), Ts{}...);
+        });
+        // we cannot move our own handler because we need it for more than one attempt so we create
+        // one more wrapper.
+        auto wrapper = [shared_control_block, attempt](std::error_code ec, Ts... r) {
+            if (shared_control_block->attempt_completed(attempt)) {
+                shared_control_block->custom_handler(ec, std::move(r)...);
+            }
+        };
+        auto all_args = std::tuple_cat(std::move(input_args), std::tuple{wrapper});
+        std::apply(f, std::move(all_args));
+    };
 
-    // TODO: cancel_async(done)?
+    shared_control_block->custom_handler = [&ctx, done = std::move(done), retryable,
+                                            shared_control_block](std::error_code ec, Ts... r) mutable {
+        auto free_resources_async = [&ctx](std::shared_ptr<control_block_type> shared_control_block) {
+            asio::post(ctx, [shared_control_block] {
+                shared_control_block->custom_handler = nullptr;
+                shared_control_block->try_next = nullptr;
+                *shared_control_block->real_cancel = nullptr;
+                shared_control_block->real_cancel = nullptr;
+            });
+        };
+
+        if (ec) {
+            if (shared_control_block->attempt++ == shared_control_block->opts.attempts ||
+                !is_retryable(retryable, ec, r...)) {
+                free_resources_async(shared_control_block);
+                done(ec, Ts{}...);  // q: only last error, what about others?
+                return;
+            }
+            const auto pause = shared_control_block->pause_before_next();
+            // budget goes last, it is not given back when retry is not made.
+            if (!shared_control_block->opts.deadline.allows(pause) || !shared_control_block->budget_allows_retry()) {
+                free_resources_async(shared_control_block);
+                done(ec, Ts{}...);
+                return;
+            } else {
+                shared_control_block->async_pause(pause, [shared_control_block](std::error_code ec) {
+                    if (!ec) {
+                        shared_control_block->try_next();
+                    } else {
+                        std::cout << "pause timer error: " << ec.message() << "\n";
+                        // done stays in custom_handler for next attempts, so we finish through it by
+                        // pretending that attempts are exhausted.
+                        shared_control_block->attempt = shared_control_block->opts.attempts;
+                        shared_control_block->custom_handler(ec, Ts{}...);
+                    }
+                });
+                return;
+            }
+        } else {
+            shared_control_block->on_success();
+            free_resources_async(shared_control_block);
+            done(ec, std::move(r)...);
+        }
+    };
 
-    // implementors of async functions can hook they implementation specific
-    // cancellation mechanism to be invoked when user wants to cancel something.
-    // implementation can put anything callable into impl and that will be invoked either by calling function
-    // or in destrcutor automatically.
-    fu2::unique_function<void()> impl;
-};
+    shared_control_block->try_next();
+}
+}  // namespace details
 
 namespace {
 cancellation_token g_dummy_token;
 }
 
 
-template <class AsyncFunction>
+// retryable decides whether failed attempt is worth another one. It is called as retryable(ec) or, for functions
+// with results, as retryable(ec, const Ts&...) if it accepts that. See retry_transient_errors.
+//
+// State of each call comes from Allocator, by default recycled per thread, see async_timeoutable.
+template <class Allocator = pooled_allocator<>, class AsyncFunction, class Retryable>
+    requires(!std::is_same_v<std::decay_t<Retryable>, cancellation_token>)
 auto async_retry(asio::io_context& ctx,
                  AsyncFunction&& f,
-                 async_retry_opts opts = {},
+                 async_retry_opts opts,
+                 Retryable retryable,
                  cancellation_token& token_ref = g_dummy_token) {
     if (opts.attempts == 0) {
         throw std::invalid_argument("0 attempts not supported by async_retry");
     }
 
-    auto real_cancel = std::make_shared<fu2::unique_function<void()>>();
+    auto real_cancel = std::allocate_shared<fu2::unique_function<void()>>(Allocator{});
     token_ref.impl = [real_cancel] {
         if (*real_cancel) {
             (*real_cancel)();
@@ -108,7 +382,8 @@ auto async_retry(asio::io_context& ctx,
         }
     };
 
-    return [f = std::move(f), opts = std::move(opts), &ctx, real_cancel](auto&&... args) {
+    return [f = std::move(f), opts = std::move(opts), retryable = std::move(retryable), &ctx,
+            real_cancel](auto&&... args) {
         static_assert(std::is_invocable_v<AsyncFunction, decltype(args)...>);
 
         auto args_as_tuple = std::forward_as_tuple(std::forward<decltype(args)>(args)...);
@@ -118,126 +393,20 @@ auto async_retry(asio::io_context& ctx,
         const auto input_args_indices = std::make_index_sequence<sizeof...(args) - 1>{};
         auto input_args = utils::select_tuple_of_refs(std::move(args_as_tuple), input_args_indices);
 
-        static_assert(std::is_invocable_v<decltype(done), std::error_code> ||
-                          std::is_invocable_v<decltype(done), std::error_code, utils::default_val&>,
+        static_assert(utils::completion_arity_v<decltype(done)> <= utils::max_completion_arity,
                       "last argument expected to be callback");
 
-        if constexpr (std::is_invocable_v<decltype(done), std::error_code>) {
-            auto shared_control_block =
-                std::make_shared<details::control_block>(std::move(opts), asio::steady_timer{ctx});
-
-            *real_cancel = [shared_control_block]() { shared_control_block->cancel(); };
-            shared_control_block->real_cancel = real_cancel;
-
-            shared_control_block->try_next = [shared_control_block, f = std::move(f),
-                                              input_args = std::move(input_args)]() {
-                // we cannot move our own handler because we need it for more than one attempt so we create
-                // one more wrapper.
-                auto wrapper = [shared_control_block](std::error_code ec) { shared_control_block->custom_handler(ec); };
-                auto all_args = std::tuple_cat(std::move(input_args), std::tuple{wrapper});
-                std::apply(f, std::move(all_args));
-            };
-
-            shared_control_block->custom_handler = [&ctx, done = std::move(done),
-                                                    shared_control_block](std::error_code ec) mutable {
-                auto free_resources_async = [&ctx](std::shared_ptr<details::control_block> shared_control_block) {
-		    asio::post(ctx, [shared_control_block] {
-                        shared_control_block->custom_handler = nullptr;
-                        shared_control_block->try_next = nullptr;
-                        *shared_control_block->real_cancel = nullptr;
-                        shared_control_block->real_cancel = nullptr;
-                    });
-                };
-
-                if (ec) {
-                    if (shared_control_block->attempt++ == shared_control_block->opts.attempts) {
-                        free_resources_async(shared_control_block);
-                        done(ec);  // q: only last error, what about others?
-                        return;
-                    } else {
-                        shared_control_block->pause_timer.expires_after(shared_control_block->opts.pause);
-                        shared_control_block->pause_timer.async_wait(
-                            [free_resources_async, shared_control_block, done = std::move(done)](std::error_code ec) {
-                                if (!ec) {
-                                    shared_control_block->try_next();
-                                } else {
-                                    std::cout << "pause timer error: " << ec.message() << "\n";
-                                    free_resources_async(shared_control_block);
-                                    done(ec);
-                                }
-                            });
-                        return;
-                    }
-                } else {
-                    free_resources_async(shared_control_block);
-                    done(ec);
-                }
-            };
-
-            shared_control_block->try_next();
-        } else {
-            // TODO: get rid of code duplication
-
-            using async_result_type = utils::result_type_t<decltype(done)>;
-
-            auto shared_control_block = std::make_shared<details::control_block_with_result<async_result_type>>(
-                std::move(opts), asio::steady_timer{ctx});
-
-            *real_cancel = [shared_control_block]() { shared_control_block->cancel(); };
-            shared_control_block->real_cancel = real_cancel;
-
-            shared_control_block->try_next = [shared_control_block, f = std::move(f),
-                                              input_args = std::move(input_args)]() {
-                // we cannot move our own handler because we need it for more than one attempt so we create
-                // one more wrapper.
-                auto wrapper = [shared_control_block](std::error_code ec, async_result_type r) {
-                    shared_control_block->custom_handler(ec, std::move(r));
-                };
-                auto all_args = std::tuple_cat(std::move(input_args), std::tuple{wrapper});
-                std::apply(f, std::move(all_args));
-            };
-
-            shared_control_block->custom_handler = [&ctx, done = std::move(done), shared_control_block](
-                                                       std::error_code ec, async_result_type r) mutable {
-                auto free_resources_async =
-                    [&ctx](
-                        std::shared_ptr<details::control_block_with_result<async_result_type>> shared_control_block) {
-			asio::post(ctx, [shared_control_block] {
-                            shared_control_block->custom_handler = nullptr;
-                            shared_control_block->try_next = nullptr;
-                            *shared_control_block->real_cancel = nullptr;
-                            shared_control_block->real_cancel = nullptr;
-                        });
-                    };
-
-                if (ec) {
-                    if (shared_control_block->attempt++ == shared_control_block->opts.attempts) {
-                        free_resources_async(shared_control_block);
-                        done(ec, async_result_type{});  // q: only last error, what about others?
-                        return;
-                    } else {
-                        shared_control_block->pause_timer.expires_after(shared_control_block->opts.pause);
-                        shared_control_block->pause_timer.async_wait(
-                            [free_resources_async, shared_control_block, done = std::move(done)](std::error_code ec) {
-                                if (!ec) {
-                                    shared_control_block->try_next();
-                                } else {
-                                    std::cout << "pause timer error: " << ec.message() << "\n";
-                                    free_resources_async(shared_control_block);
-                                    done(ec, async_result_type{});  // q: only last error, what about others?
-                                }
-                            });
-                        return;
-                    }
-                } else {
-                    free_resources_async(shared_control_block);
-                    done(ec, std::move(r));
-                }
-            };
-
-            shared_control_block->try_next();
-        }
+        details::start_retry<Allocator>(utils::completion_args_of<decltype(done)>(), ctx, f, opts, retryable, real_cancel,
+                             std::move(done), std::move(input_args));
     };
 }
 
+template <class Allocator = pooled_allocator<>, class AsyncFunction>
+auto async_retry(asio::io_context& ctx,
+                 AsyncFunction&& f,
+                 async_retry_opts opts = {},
+                 cancellation_token& token_ref = g_dummy_token) {
+    return async_retry<Allocator>(ctx, std::forward<AsyncFunction>(f), std::move(opts), retry_any_error{}, token_ref);
+}
+
 }  // namespace lsem::async
@@ -7,9 +7,11 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include <algorithm>
 #include <chrono>
 #include <optional>
 #include <string>
+#include <tuple>
 #include <vector>
 
 using namespace std::chrono_literals;
@@ -277,6 +279,28 @@ TEST(async_retry_tests, result_is_moved_properly) {
     EXPECT_EQ(*std::get<1>(*actual_result), 42);
 }
 
+TEST(async_retry_tests, handler_state_survives_failed_attempt) {
+    asio::io_context ctx;
+
+    int called_times = 0;
+    auto async_op = [&called_times](asio::io_context& ctx, auto done_cb) {
+        called_times++;
+        done_cb(called_times == 1 ? make_error_code(std::errc::io_error) : std::error_code(), called_times);
+    };
+    auto async_op_with_retry = async_retry(ctx, async_op, {.attempts = 3, .pause = 0s});
+
+    std::optional<std::tuple<std::error_code, int>> actual_result;
+    async_op_with_retry(ctx, [&, owned = std::make_unique<int>(7)](std::error_code ec, int r) {
+        ASSERT_TRUE(owned);
+        actual_result = std::tuple{ec, r + *owned};
+    });
+
+    ctx.run();
+    ASSERT_TRUE(actual_result.has_value());
+    EXPECT_EQ(actual_result, (std::tuple{std::error_code(), 9}));
+    EXPECT_EQ(called_times, 2);
+}
+
 TEST(async_retry_tests, options_are_respected__one_attempt) {
     asio::io_context ctx;
 
@@ -328,6 +352,338 @@ TEST(async_retry_tests, options_are_respected__five_attempts_with_custom_pause)
                 400 / 20);  // 5% tollerance
 }
 
+TEST(async_retry_tests, backoff__fixed_is_default) {
+    std::chrono::steady_clock::duration prev{};
+    const async_retry_opts opts{.pause = 100ms};
+    EXPECT_EQ(details::next_pause(opts, 0, prev), 100ms);
+    EXPECT_EQ(details::next_pause(opts, 10, prev), 100ms);
+}
+
+TEST(async_retry_tests, backoff__exponential_capped) {
+    std::chrono::steady_clock::duration prev{};
+    const async_retry_opts opts{.pause = 100ms, .backoff = backoff_kind::exponential, .max_pause = 1s};
+    EXPECT_EQ(details::next_pause(opts, 0, prev), 100ms);
+    EXPECT_EQ(details::next_pause(opts, 1, prev), 200ms);
+    EXPECT_EQ(details::next_pause(opts, 3, prev), 800ms);
+    EXPECT_EQ(details::next_pause(opts, 4, prev), 1s);
+    EXPECT_EQ(details::next_pause(opts, 1000, prev), 1s);
+}
+
+TEST(async_retry_tests, backoff__jitter_stays_in_bounds) {
+    const async_retry_opts full{.pause = 100ms, .backoff = backoff_kind::full_jitter, .max_pause = 1s};
+    const async_retry_opts decorrelated{.pause = 100ms, .backoff = backoff_kind::decorrelated_jitter, .max_pause = 1s};
+
+    std::chrono::steady_clock::duration prev{};
+    for (unsigned retry = 0; retry < 100; ++retry) {
+        const auto pause = details::next_pause(full, retry, prev);
+        EXPECT_GE(pause, 0ms);
+        EXPECT_LE(pause, std::min<std::chrono::steady_clock::duration>(1s, 100ms * (1ull << std::min(retry, 20u))));
+    }
+
+    for (unsigned retry = 0; retry < 100; ++retry) {
+        const auto prev_before = prev;
+        const auto pause = details::next_pause(decorrelated, retry, prev);
+        EXPECT_GE(pause, 100ms);
+        EXPECT_LE(pause, 1s);
+        if (prev_before != std::chrono::steady_clock::duration::zero()) {
+            EXPECT_LE(pause, prev_before * 3);
+        }
+        EXPECT_EQ(prev, pause);
+    }
+}
+
+TEST(async_retry_tests, backoff__decorrelated_jitter_spreads_first_retry) {
+    asio::io_context ctx;
+    const async_retry_opts opts{
+        .attempts = 2, .pause = 20ms, .backoff = backoff_kind::decorrelated_jitter, .max_pause = 1s};
+
+    // all instances fail at once, their second attempts should not come together.
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<std::chrono::steady_clock::duration> retried_after;
+    for (int i = 0; i < 50; ++i) {
+        auto attempt = std::make_shared<int>(0);
+        async_retry(
+            ctx,
+            [&, attempt](auto done) {
+                if ((*attempt)++ == 0) {
+                    asio::post(ctx, [done = std::move(done)]() mutable {
+                        done(make_error_code(std::errc::connection_refused));
+                    });
+                    return;
+                }
+                retried_after.push_back(std::chrono::steady_clock::now() - start);
+                asio::post(ctx, [done = std::move(done)]() mutable { done(std::error_code()); });
+            },
+            opts)([](std::error_code ec) { EXPECT_FALSE(ec); });
+    }
+    ctx.run();
+
+    ASSERT_EQ(retried_after.size(), 50);
+    const auto [first, last] = std::minmax_element(retried_after.begin(), retried_after.end());
+    EXPECT_GE(*first, 20ms);
+    EXPECT_GT(*last - *first, 10ms);
+
+    // pauses themselves, free of scheduling noise.
+    std::vector<std::chrono::steady_clock::duration> first_pauses;
+    for (int i = 0; i < 50; ++i) {
+        std::chrono::steady_clock::duration prev{};
+        first_pauses.push_back(details::next_pause(opts, 0, prev));
+    }
+    EXPECT_GT(std::count_if(first_pauses.begin(), first_pauses.end(), [&](auto p) { return p != opts.pause; }), 45);
+    EXPECT_LE(*std::max_element(first_pauses.begin(), first_pauses.end()), opts.pause * 3);
+}
+
+TEST(async_retry_tests, options_are_respected__exponential_backoff) {
+    asio::io_context ctx;
+
+    int called_times = 0;
+    auto async_op = [&called_times](asio::io_context& ctx, auto done_cb) {
+        called_times++;
+        done_cb(make_error_code(std::errc::io_error), 0);
+    };
+
+    auto async_op_with_retry =
+        async_retry(ctx, async_op, {.attempts = 4, .pause = 50ms, .backoff = backoff_kind::exponential});
+
+    auto start_time = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::duration time_taken;
+    std::optional<std::tuple<std::error_code, int>> actual_result;
+    async_op_with_retry(ctx, [&](std::error_code ec, int r) {
+        actual_result = std::tuple{ec, r};
+        time_taken = std::chrono::steady_clock::now() - start_time;
+    });
+
+    ctx.run();
+    ASSERT_TRUE(actual_result.has_value());
+    EXPECT_EQ(called_times, 4);
+
+    // pauses of 50, 100 and 200ms.
+    EXPECT_NEAR(std::chrono::duration_cast<std::chrono::milliseconds>(time_taken).count(), 350, 350 / 20);
+}
+
+TEST(async_retry_tests, retry_budget__withdraw_and_deposit) {
+    retry_budget budget(0.5, 2);
+
+    EXPECT_TRUE(budget.try_withdraw());
+    EXPECT_TRUE(budget.try_withdraw());
+    EXPECT_FALSE(budget.try_withdraw());
+
+    budget.deposit();
+    EXPECT_FALSE(budget.try_withdraw());
+    budget.deposit();
+    EXPECT_TRUE(budget.try_withdraw());
+
+    for (int i = 0; i < 100; ++i) {
+        budget.deposit();
+    }
+    EXPECT_DOUBLE_EQ(budget.tokens(), 2.0);
+}
+
+TEST(async_retry_tests, retry_budget__exhausted_budget_fails_fast) {
+    asio::io_context ctx;
+
+    int called_times = 0;
+    auto failing_op = [&called_times](asio::io_context& ctx, auto done_cb) {
+        called_times++;
+        done_cb(make_error_code(std::errc::io_error), 0);
+    };
+    auto succeeding_op = [](asio::io_context& ctx, auto done_cb) { done_cb(std::error_code(), 1); };
+
+    auto budget = std::make_shared<retry_budget>(0.5, 1);
+    const async_retry_opts opts{.attempts = 3, .pause = 0s, .budget = budget};
+
+    std::vector<std::error_code> results;
+    auto record = [&](std::error_code ec, int) { results.push_back(ec); };
+
+    // one token: only one retry allowed for both instances together.
+    async_retry(ctx, failing_op, opts)(ctx, record);
+    ctx.run();
+    ctx.restart();
+    async_retry(ctx, failing_op, opts)(ctx, record);
+    ctx.run();
+    ctx.restart();
+    EXPECT_EQ(called_times, 3);
+
+    // two successes refill one token.
+    async_retry(ctx, succeeding_op, opts)(ctx, record);
+    async_retry(ctx, succeeding_op, opts)(ctx, record);
+    ctx.run();
+    ctx.restart();
+    async_retry(ctx, failing_op, opts)(ctx, record);
+    ctx.run();
+    EXPECT_EQ(called_times, 5);
+    EXPECT_EQ(results.size(), 5);
+}
+
+TEST(async_retry_tests, retryable__permanent_error_is_not_retried) {
+    asio::io_context ctx;
+
+    int called_times = 0;
+    auto async_op = [&called_times](asio::io_context& ctx, auto done_cb) {
+        called_times++;
+        done_cb(called_times == 1 ? make_error_code(std::errc::connection_reset)
+                                  : make_error_code(std::errc::permission_denied));
+    };
+
+    std::optional<std::error_code> actual_result;
+    async_retry(ctx, async_op, {.attempts = 5, .pause = 0s}, retry_transient_errors{})(
+        ctx, [&](std::error_code ec) { actual_result = ec; });
+    ctx.run();
+
+    EXPECT_EQ(actual_result, make_error_code(std::errc::permission_denied));
+    EXPECT_EQ(called_times, 2);
+}
+
+TEST(async_retry_tests, retryable__sees_result) {
+    asio::io_context ctx;
+
+    int called_times = 0;
+    auto async_op = [&called_times](asio::io_context& ctx, auto done_cb) {
+        called_times++;
+        // pretend 503 and 404 http statuses reported alongside the error.
+        done_cb(make_error_code(std::errc::io_error), called_times < 3 ? 503 : 404);
+    };
+    auto retry_unavailable = [](std::error_code, const int& status) { return status == 503; };
+
+    std::optional<std::error_code> actual_result;
+    async_retry(ctx, async_op, {.attempts = 5, .pause = 0s}, retry_unavailable)(
+        ctx, [&](std::error_code ec, int) { actual_result = ec; });
+    ctx.run();
+
+    EXPECT_EQ(actual_result, make_error_code(std::errc::io_error));
+    EXPECT_EQ(called_times, 3);
+}
+
+TEST(async_retry_tests, attempt_timeout__hung_attempt_is_retried) {
+    asio::io_context ctx;
+
+    // first attempt replies way too late, second one is in time.
+    int called_times = 0;
+    std::vector<int> replies;
+    auto async_op = [&](asio::io_context& ctx, auto done_cb) {
+        const int attempt = ++called_times;
+        lsem::async::async_sleep(ctx, attempt == 1 ? 200ms : 10ms, [done_cb, attempt, &replies](std::error_code) {
+            replies.push_back(attempt);
+            done_cb(std::error_code(), attempt);
+        });
+    };
+
+    std::optional<std::tuple<std::error_code, int>> actual_result;
+    int done_called = 0;
+    async_retry(ctx, async_op, {.attempts = 3, .pause = 0s, .attempt_timeout = 50ms})(
+        ctx, [&](std::error_code ec, int r) {
+            done_called++;
+            actual_result = std::tuple{ec, r};
+        });
+    ctx.run();
+
+    ASSERT_TRUE(actual_result.has_value());
+    EXPECT_EQ(std::get<0>(*actual_result), std::error_code());
+    EXPECT_EQ(std::get<1>(*actual_result), 2);
+    EXPECT_EQ(called_times, 2);
+    // late reply of the first attempt arrived, but was dropped.
+    EXPECT_EQ(replies, (std::vector<int>{2, 1}));
+    EXPECT_EQ(done_called, 1);
+}
+
+TEST(async_retry_tests, attempt_timeout__every_attempt_hangs) {
+    asio::io_context ctx;
+
+    int called_times = 0;
+    auto async_op = [&](asio::io_context& ctx, auto done_cb) {
+        called_times++;
+        lsem::async::async_sleep(ctx, 100ms, [done_cb](std::error_code) { done_cb(std::error_code()); });
+    };
+
+    std::optional<std::error_code> actual_result;
+    async_retry(ctx, async_op, {.attempts = 2, .pause = 0s, .attempt_timeout = 20ms})(
+        ctx, [&](std::error_code ec) { actual_result = ec; });
+    ctx.run();
+
+    EXPECT_EQ(actual_result, make_error_code(std::errc::timed_out));
+    EXPECT_EQ(called_times, 2);
+}
+
+TEST(async_retry_tests, deadline__no_retry_past_it) {
+    asio::io_context ctx;
+
+    int called_times = 0;
+    auto async_op = [&](asio::io_context& ctx, auto done_cb) {
+        called_times++;
+        done_cb(make_error_code(std::errc::io_error));
+    };
+
+    // attempts at 0, 20 and 40ms, pause after the third one would end past the deadline.
+    std::optional<std::error_code> actual_result;
+    const auto start = std::chrono::steady_clock::now();
+    async_retry(ctx, async_op, {.attempts = 10, .pause = 20ms, .deadline = deadline::after(50ms)})(
+        ctx, [&](std::error_code ec) { actual_result = ec; });
+    ctx.run();
+
+    EXPECT_EQ(actual_result, make_error_code(std::errc::io_error));
+    EXPECT_EQ(called_times, 3);
+    EXPECT_LT(std::chrono::steady_clock::now() - start, 50ms);
+}
+
+TEST(async_retry_tests, deadline__times_out_attempt_in_flight) {
+    asio::io_context ctx;
+
+    int called_times = 0;
+    auto async_op = [&](asio::io_context& ctx, auto done_cb) {
+        called_times++;
+        lsem::async::async_sleep(ctx, 100ms, [done_cb](std::error_code) { done_cb(std::error_code(), 1); });
+    };
+
+    std::optional<std::tuple<std::error_code, int>> actual_result;
+    async_retry(ctx, async_op, {.attempts = 3, .pause = 0s, .attempt_timeout = 1s, .deadline = deadline::after(20ms)})(
+        ctx, [&](std::error_code ec, int r) { actual_result.emplace(ec, r); });
+    ctx.run();
+
+    // once deadline passed, even zero pause does not fit before it.
+    EXPECT_EQ(actual_result, std::tuple(make_error_code(std::errc::timed_out), 0));
+    EXPECT_EQ(called_times, 1);
+}
+
+TEST(async_retry_tests, deadline__expired_one_is_not_attempted) {
+    asio::io_context ctx;
+
+    int called_times = 0;
+    auto async_op = [&](asio::io_context& ctx, auto done_cb) {
+        called_times++;
+        done_cb(std::error_code());
+    };
+
+    std::optional<std::error_code> actual_result;
+    async_retry(ctx, async_op, {.deadline = deadline(std::chrono::steady_clock::now())})(
+        ctx, [&](std::error_code ec) { actual_result = ec; });
+    ctx.run();
+
+    EXPECT_EQ(actual_result, make_error_code(std::errc::timed_out));
+    EXPECT_EQ(called_times, 0);
+}
+
+TEST(async_retry_tests, multiple_results) {
+    asio::io_context ctx;
+
+    int called_times = 0;
+    auto async_read = [&called_times](asio::io_context& ctx, auto done_cb) {
+        if (++called_times < 3) {
+            done_cb(make_error_code(std::errc::io_error), std::string("garbage"), 7u);
+        } else {
+            done_cb(std::error_code(), std::string("data"), 4u);
+        }
+    };
+    auto retry_short_reads = [](std::error_code, const std::string&, const unsigned& size) { return size > 0; };
+
+    std::optional<std::tuple<std::error_code, std::string, unsigned>> actual_result;
+    async_retry(ctx, async_read, {.attempts = 3, .pause = 0s}, retry_short_reads)(
+        ctx, [&](std::error_code ec, std::string data, unsigned size) { actual_result.emplace(ec, data, size); });
+    ctx.run();
+
+    EXPECT_EQ(called_times, 3);
+    EXPECT_EQ(actual_result, std::tuple(std::error_code(), std::string("data"), 4u));
+}
+
 TEST(async_retry_tests, options_are_respected__zero_attempts) {
     asio::io_context ctx;
 
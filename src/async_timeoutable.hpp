@@ -1,14 +1,22 @@
 #pragma once
 
 #include <asio/steady_timer.hpp>
+#include <atomic>
 #include <chrono>
 #include <functional>
 #include <iostream>
+#include <memory>
 #include <optional>
 #include <system_error>
 #include <type_traits>
 #include <utility>
 
+#include "adaptive_timeout.hpp"
+#include "cancellation_token.hpp"
+#include "pooled_allocator.hpp"
+#include "deadline.hpp"
+#include "timer_coalescer.hpp"
+#include "timing_wheel.hpp"
 #include "utils.hpp"
 
 namespace lsem::async {
@@ -20,22 +28,85 @@ struct is_duration : std::false_type {};
 template <class Rep, class Period>
 struct is_duration<std::chrono::duration<Rep, Period>> : std::true_type {};
 
-struct control_block_t {
-    bool timeout_flag = false;
-    bool done_flag = false;
-    asio::steady_timer timeout_timer;
-
-    control_block_t(asio::steady_timer timeout_timer) : timeout_timer(std::move(timeout_timer)) {}
+// Timer is asio::steady_timer or anything with the same expires_after/async_wait/cancel, e.g. wheel_timer or
+// coalesced_timer.
+//
+// Completion and timeout race for a single atomic state word, first one to mark it wins and the other backs off. With
+// asio::steady_timer operation may therefore complete on a different thread than the one running the timer handler
+// (io_context run by a pool of threads, no strand needed). wheel_timer and coalesced_timer are not thread safe, with
+// them operation has to complete on the thread(s) running their io_context serially.
+template <class Timer>
+struct basic_control_block {
+    static constexpr unsigned started = 1u;  // call of wrapped operation returned, its token is set up.
+    static constexpr unsigned completed = 2u;
+    static constexpr unsigned timed_out = 4u;
+
+    std::atomic<unsigned> state{0u};
+    Timer timeout_timer;
+    // hook of the wrapped operation, cancelled when timeout wins. Left empty for operations not taking a token.
+    cancellation_token token;
+
+    template <class TimerArg>
+    explicit basic_control_block(TimerArg&& timer_arg) : timeout_timer(std::forward<TimerArg>(timer_arg)) {}
+
+    // Sets `how` (completed or timed_out) unless one of them is already set. Returns state before that, nullopt when
+    // the other side won.
+    std::optional<unsigned> try_finish(unsigned how) {
+        auto s = state.load(std::memory_order_acquire);
+        do {
+            if (s & (completed | timed_out)) {
+                return std::nullopt;
+            }
+        } while (!state.compare_exchange_weak(s, s | how, std::memory_order_acq_rel, std::memory_order_acquire));
+        return s;
+    }
+
+    unsigned mark_started() { return state.fetch_or(started, std::memory_order_acq_rel); }
+
+    // for reuse by the next operation. Late handlers of the previous one have to tell themselves apart, e.g. by
+    // attempt number.
+    void reset() { state.store(0u, std::memory_order_relaxed); }
 };
 
-}  // namespace details
-
-// TODO: write documentation and usage examples.
-template <class Callable>
-auto async_timeoutable(asio::io_context& ctx, Callable&& c) {
-    return [c = std::forward<Callable>(c), &ctx](auto&&... args) {
-        using namespace details;
+using control_block_t = basic_control_block<asio::steady_timer>;
+
+template <class Callable, class Args, class Handler>
+struct invocable_with_args;
+
+template <class Callable, class... Args, class Handler>
+struct invocable_with_args<Callable, std::tuple<Args...>, Handler> : std::is_invocable<Callable, Args..., Handler> {};
+
+// Reports timed_out to done unless operation completes first.
+template <std::size_t Arity, class ControlBlockPtr, class DonePtr>
+void arm_timeout_timer(const ControlBlockPtr& control_block,
+                       const DonePtr& done_ptr,
+                       std::chrono::steady_clock::duration timeout) {
+    control_block->timeout_timer.expires_after(timeout);
+    control_block->timeout_timer.async_wait([done_ptr, control_block](std::error_code ec) {
+        using block_type = typename ControlBlockPtr::element_type;
+        if (!ec) {
+            if (const auto prev = control_block->try_finish(block_type::timed_out)) {
+                // abort abandoned operation, whatever it reports from now on is ignored. While operation is still
+                // being started, its token is not ours to touch, the starting thread cancels it afterwards.
+                if (*prev & block_type::started) {
+                    control_block->token.cancel();
+                }
+                utils::invoke_with_defaults<Arity>(**done_ptr, make_error_code(std::errc::timed_out));
+                // free resources
+                *done_ptr = std::nullopt;
+                return;
+            }
+        } else if (ec != asio::error::operation_aborted) {
+            std::cerr << "async_timeoutable: timeout timer error: " << ec.message() << "\n";
+        }
+    });
+}
 
+// timer_source is whatever Timer is constructed from: io_context for steady_timer, timing_wheel for wheel_timer,
+// timer_coalescer for coalesced_timer. State of every call is allocated with Allocator.
+template <class Timer, class Allocator, class TimerSource, class Callable>
+auto make_timeoutable(TimerSource& timer_source, Callable&& c) {
+    return [c = std::forward<Callable>(c), &timer_source](auto&&... args) {
         // We expect the following layout of arguments: (timeout, a1, a2, ..., an, done_cb);
         /// having that we need to extract (a1, a2, ..., an), append our own version of done_cb
         // and pass it to callable. a1, a2, ..., an should be forwarded correctly.
@@ -45,13 +116,13 @@ auto async_timeoutable(asio::io_context& ctx, Callable&& c) {
 
         auto args_as_tuple = std::forward_as_tuple(std::forward<decltype(args)>(args)...);
 
-        auto timeout_duration = std::get<0>(args_as_tuple);
+        auto timeout_arg = std::get<0>(args_as_tuple);
         auto done = std::get<sizeof...(args) - 1>(std::move(args_as_tuple));
 
-        static_assert(is_duration<std::decay_t<decltype(timeout_duration)>>::value,
-                      "first argument expected to be timeout of duration type");
-        static_assert(std::is_invocable_v<decltype(done), std::error_code> ||
-                          std::is_invocable_v<decltype(done), std::error_code, utils::default_val&>,
+        constexpr bool with_deadline = std::is_same_v<std::decay_t<decltype(timeout_arg)>, deadline>;
+        static_assert(is_duration<std::decay_t<decltype(timeout_arg)>>::value || with_deadline,
+                      "first argument expected to be timeout of duration type or deadline");
+        static_assert(utils::completion_arity_v<decltype(done)> <= utils::max_completion_arity,
                       "last argument expected to be callback");
 
         const auto input_args_indices = utils::offset_sequence_t<1, std::make_index_sequence<sizeof...(args) - 2>>{};
@@ -61,69 +132,123 @@ auto async_timeoutable(asio::io_context& ctx, Callable&& c) {
         // variables. first who comes, assigns nullopt and this is indication that it is second. this would also free
         // resources.
 
-        auto control_block = std::make_shared<control_block_t>(asio::steady_timer(ctx));
-
-        // TODO: get rid of code duplication
-        if constexpr (std::is_invocable_v<decltype(done), std::error_code>) {
-            auto done_ptr = std::make_shared<std::optional<decltype(done)>>(std::move(done));
-
-            control_block->timeout_timer.expires_after(timeout_duration);
-            control_block->timeout_timer.async_wait([done_ptr, control_block](std::error_code ec) {
-                if (!ec) {
-                    if (!control_block->done_flag) {
-                        control_block->timeout_flag = true;
-                        (**done_ptr)(make_error_code(std::errc::timed_out));
-                        // free resources
-                        *done_ptr = std::nullopt;
-                        return;
-                    }
-                } else if (ec != asio::error::operation_aborted) {
-                    std::cerr << "async_timeoutable: timeout timer error: " << ec.message() << "\n";
-                }
-            });
-
-            auto patched_handler = [done_ptr, control_block](std::error_code ec) {
-                if (!control_block->timeout_flag) {
-                    control_block->done_flag = true;
-                    // TODO: free control block instead of cancelling
-                    control_block->timeout_timer.cancel();
-                    (**done_ptr)(ec);
-                    *done_ptr = std::nullopt;
+        // done may take any number of values after error_code, on timeout they are all default constructed.
+        constexpr std::size_t arity = utils::completion_arity_v<decltype(done)>;
+
+        bool arm_timeout = true;
+        std::chrono::steady_clock::duration timeout_duration{};
+        if constexpr (with_deadline) {
+            // nobody waits for results of the operation anymore, so it is not even started.
+            if (timeout_arg.expired()) {
+                utils::invoke_with_defaults<arity>(done, make_error_code(std::errc::timed_out));
+                return;
+            }
+            arm_timeout = !timeout_arg.unbounded();
+            timeout_duration = timeout_arg.remaining();
+        } else {
+            timeout_duration = timeout_arg;
+        }
+
+        using block_type = basic_control_block<Timer>;
+        auto control_block = std::allocate_shared<block_type>(Allocator{}, timer_source);
+        auto done_ptr = std::allocate_shared<std::optional<decltype(done)>>(Allocator{}, std::move(done));
+
+        if (arm_timeout) {
+            arm_timeout_timer<arity>(control_block, done_ptr, timeout_duration);
+        }
+
+        auto patched_handler = [done_ptr, control_block](std::error_code ec, auto&&... r) {
+            if (const auto prev = control_block->try_finish(block_type::completed)) {
+                // nothing to cancel anymore, token would cancel on destruction otherwise. Completion that comes
+                // before operation call returned leaves it to the starting thread.
+                if (*prev & block_type::started) {
+                    control_block->token.impl = nullptr;
                 }
-            };
+                // TODO: free control block instead of cancelling
+                control_block->timeout_timer.cancel();
+                (**done_ptr)(ec, std::forward<decltype(r)>(r)...);
+                *done_ptr = std::nullopt;
+            }
+        };
+        // callable not invocable with args as is is expected to take cancellation_token& first, like async_hedge
+        // ones, so it can hook its cancellation into it. checked in this order not to instantiate variadic callables
+        // with the token.
+        using callable_t = const std::decay_t<Callable>&;
+        if constexpr (invocable_with_args<callable_t, decltype(input_args), decltype(patched_handler)>::value) {
             auto patched_args = std::tuple_cat(std::move(input_args), std::tuple(patched_handler));
             std::apply(c, std::move(patched_args));
         } else {
-            auto done_ptr = std::make_shared<std::optional<decltype(done)>>(std::move(done));
-
-            control_block->timeout_timer.expires_after(timeout_duration);
-            control_block->timeout_timer.async_wait([done_ptr, control_block](std::error_code ec) {
-                if (!ec) {
-                    if (!control_block->done_flag) {
-                        control_block->timeout_flag = true;
-                        (**done_ptr)(make_error_code(std::errc::timed_out), utils::default_val{});
-                        // free resources
-                        *done_ptr = std::nullopt;
-                        return;
-                    }
-                } else if (ec != asio::error::operation_aborted) {
-                    std::cerr << "async_timeoutable: timeout timer error: " << ec.message() << "\n";
-                }
-            });
-
-            auto patched_handler = [done_ptr, control_block](std::error_code ec, auto&& r) {
-                if (!control_block->timeout_flag) {
-                    control_block->done_flag = true;
-                    // TODO: free control block instead of cancelling
-                    control_block->timeout_timer.cancel();
-                    (**done_ptr)(ec, std::forward<decltype(r)>(r));
-                    *done_ptr = std::nullopt;
-                }
-            };
-
-            auto patched_args = std::tuple_cat(std::move(input_args), std::tuple(patched_handler));
+            auto patched_args = std::tuple_cat(std::forward_as_tuple(control_block->token), std::move(input_args),
+                                               std::tuple(patched_handler));
             std::apply(c, std::move(patched_args));
         }
+
+        const auto state = control_block->mark_started();
+        if (state & block_type::timed_out) {
+            control_block->token.cancel();
+        } else if (state & block_type::completed) {
+            control_block->token.impl = nullptr;
+        }
+    };
+}
+
+// Done feeding latency of successful and timed out calls to policy.
+template <std::size_t Arity, class Done>
+auto measure_latency(adaptive_timeout& policy, Done done) {
+    return [&policy, start = std::chrono::steady_clock::now(), done = std::move(done)](
+               std::error_code ec, auto&&... r) mutable requires(sizeof...(r) == Arity) {
+        // failures, typically fast ones like refused connection, tell nothing about how long a call takes.
+        if (!ec || ec == std::errc::timed_out) {
+            policy.record(std::chrono::steady_clock::now() - start);
+        }
+        done(ec, std::forward<decltype(r)>(r)...);
+    };
+}
+
+}  // namespace details
+
+// TODO: write documentation and usage examples.
+// Instead of timeout, deadline may be passed as the first argument (to any of the overloads). Operation is timed out
+// when it passes and is not started at all if it already has.
+// State of each call comes from Allocator, by default recycled per thread. Any stateless allocator, e.g.
+// std::allocator<void>, may be given instead: async_timeoutable<std::allocator<void>>(ctx, c).
+template <class Allocator = pooled_allocator<>, class Callable>
+auto async_timeoutable(asio::io_context& ctx, Callable&& c) {
+    return details::make_timeoutable<asio::steady_timer, Allocator>(ctx, std::forward<Callable>(c));
+}
+
+// Same, but timeouts are kept in timing_wheel instead of a steady_timer per call. Cheaper with many operations in
+// flight at the cost of tick precision. timing_wheel is not thread safe: calls have to be made and completed on the
+// thread running its io_context (or serially, e.g. through a strand).
+template <class Allocator = pooled_allocator<>, class Callable>
+auto async_timeoutable(timing_wheel& wheel, Callable&& c) {
+    return details::make_timeoutable<wheel_timer, Allocator>(wheel, std::forward<Callable>(c));
+}
+
+// Same, but timeout may fire up to coalescer.slack() * timeout late, so that timeouts of many calls share wakeups.
+// timer_coalescer is not thread safe: calls have to be made and completed on the thread running its io_context (or
+// serially, e.g. through a strand).
+template <class Allocator = pooled_allocator<>, class Callable>
+auto async_timeoutable(timer_coalescer& coalescer, Callable&& c) {
+    return details::make_timeoutable<coalesced_timer, Allocator>(coalescer, std::forward<Callable>(c));
+}
+
+// Same, but timeout is not passed, it is taken from policy which learns it from latencies of previous calls. Result
+// is called as (args..., done_cb). Policy has to outlive the calls, there is usually one per call site.
+template <class Allocator = pooled_allocator<>, class Callable>
+auto async_timeoutable(asio::io_context& ctx, adaptive_timeout& policy, Callable&& c) {
+    return [timeoutable = async_timeoutable<Allocator>(ctx, std::forward<Callable>(c)), &policy](auto&&... args) {
+        static_assert(sizeof...(args) >= 1, "at least done_cb expected (expected signature: void(args..., done_cb))");
+
+        auto args_as_tuple = std::forward_as_tuple(std::forward<decltype(args)>(args)...);
+        auto done = std::get<sizeof...(args) - 1>(std::move(args_as_tuple));
+        auto input_args =
+            utils::select_tuple_of_refs(std::move(args_as_tuple), std::make_index_sequence<sizeof...(args) - 1>{});
+
+        constexpr std::size_t arity = utils::completion_arity_v<decltype(done)>;
+        auto measured_done = details::measure_latency<arity>(policy, std::move(done));
+        std::apply(timeoutable, std::tuple_cat(std::tuple(policy.timeout()), std::move(input_args),
+                                               std::forward_as_tuple(std::move(measured_done))));
     };
 }
 
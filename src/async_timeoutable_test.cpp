@@ -5,9 +5,12 @@
 #include <asio/steady_timer.hpp>
 
 #include <gtest/gtest.h>
+#include <atomic>
 #include <chrono>
 #include <optional>
 #include <string>
+#include <thread>
+#include <tuple>
 #include <vector>
 
 using namespace std::chrono_literals;
@@ -193,6 +196,26 @@ TEST(async_timeoutable_tests, without_results__and_params_test) {
     EXPECT_EQ(wifi_scan_async_with_timeout_result2, make_error_code(std::errc::timed_out));
 }
 
+TEST(async_timeoutable_tests, multiple_results_test) {
+    asio::io_context ctx;
+
+    // read reporting both bytes and number of bytes, like asio completion handlers do.
+    auto async_read = [&ctx](std::chrono::steady_clock::duration delay, auto done) {
+        async_sleep(ctx, delay, [done] { done(std::error_code(), std::string("data"), 4u); });
+    };
+
+    std::vector<std::tuple<std::error_code, std::string, unsigned>> results;
+    auto record = [&](std::error_code ec, std::string data, unsigned size) { results.emplace_back(ec, data, size); };
+
+    async_timeoutable(ctx, async_read)(100ms, 10ms, record);
+    async_timeoutable(ctx, async_read)(10ms, 100ms, record);
+    ctx.run();
+
+    ASSERT_EQ(results.size(), 2);
+    EXPECT_EQ(results[0], std::tuple(std::error_code(), std::string("data"), 4u));
+    EXPECT_EQ(results[1], std::tuple(make_error_code(std::errc::timed_out), std::string(), 0u));
+}
+
 TEST(async_timeoutable_tests, wrapped_callable_can_passed_as_rvalue) {
     asio::io_context ctx;
 
@@ -486,3 +509,162 @@ TEST(async_timeoutable_tests, use_case_with_socket_2) {
 
     ASSERT_EQ(result, std::errc::timed_out);
 }
+
+TEST(async_timeoutable_tests, timeout_cancels_operation_taking_token) {
+    asio::io_context ctx;
+
+    simple_socket sock(ctx, 5s);
+
+    // operation taking token first gets it hooked to timeout, so socket is closed without done doing it.
+    auto shutdown = [](cancellation_token& token, simple_socket& sock, auto done) {
+        token.impl = [&sock] { sock.close(); };
+        sock.async_shutdown(std::move(done));
+    };
+
+    std::optional<std::error_code> result;
+    const auto start = std::chrono::steady_clock::now();
+    async_timeoutable(ctx, shutdown)(10ms, sock, [&result](std::error_code ec) { result = ec; });
+    ctx.run();
+
+    ASSERT_EQ(result, std::errc::timed_out);
+    EXPECT_LT(std::chrono::steady_clock::now() - start, 1s);
+}
+
+TEST(async_timeoutable_tests, completed_operation_taking_token_is_not_cancelled) {
+    asio::io_context ctx;
+
+    simple_socket sock(ctx, 10ms);
+
+    int cancelled = 0;
+    auto shutdown = [&cancelled](cancellation_token& token, simple_socket& sock, auto done) {
+        token.impl = [&cancelled] { ++cancelled; };
+        sock.async_shutdown(std::move(done));
+    };
+
+    std::optional<std::error_code> result;
+    async_timeoutable(ctx, shutdown)(1s, sock, [&result](std::error_code ec) { result = ec; });
+    ctx.run();
+
+    ASSERT_EQ(result, std::error_code());
+    EXPECT_EQ(cancelled, 0);
+}
+
+TEST(async_timeoutable_tests, deadline_instead_of_timeout) {
+    asio::io_context ctx;
+
+    auto async_op = [&ctx](std::chrono::steady_clock::duration delay, auto done) {
+        async_sleep(ctx, delay, [done] { done(std::error_code(), 42); });
+    };
+
+    std::vector<std::tuple<std::error_code, int>> results;
+    auto record = [&](std::error_code ec, int r) { results.emplace_back(ec, r); };
+
+    const auto d = deadline::after(30ms);
+    async_timeoutable(ctx, async_op)(d, 10ms, record);
+    async_timeoutable(ctx, async_op)(d, 100ms, record);
+    async_timeoutable(ctx, async_op)(deadline::never(), 50ms, record);
+    ctx.run();
+
+    EXPECT_EQ(results, (std::vector<std::tuple<std::error_code, int>>{
+                           {std::error_code(), 42}, {make_error_code(std::errc::timed_out), 0}, {std::error_code(), 42}}));
+}
+
+TEST(async_timeoutable_tests, deadline_is_passed_down_to_nested_calls) {
+    asio::io_context ctx;
+
+    // each step is given its own 40ms, but they all share one 50ms deadline.
+    int started = 0;
+    auto step = [&](std::chrono::steady_clock::duration delay, auto done) {
+        started++;
+        async_sleep(ctx, delay, [done] { done(std::error_code()); });
+    };
+    auto two_steps = [&](deadline d, auto done) {
+        async_timeoutable(ctx, step)(d.sooner(40ms), 30ms, [&ctx, &step, d, done](std::error_code ec) {
+            if (ec) {
+                done(ec);
+                return;
+            }
+            async_timeoutable(ctx, step)(d.sooner(40ms), 30ms, done);
+        });
+    };
+
+    const auto d = deadline::after(50ms);
+    std::optional<std::error_code> result;
+    std::chrono::steady_clock::time_point finished_at;
+    async_timeoutable(ctx, two_steps)(d, d, [&](std::error_code ec) {
+        result = ec;
+        finished_at = std::chrono::steady_clock::now();
+    });
+    ctx.run();
+
+    EXPECT_EQ(result, make_error_code(std::errc::timed_out));
+    EXPECT_EQ(started, 2);
+    EXPECT_GE(finished_at, d.at());
+    EXPECT_LT(finished_at - d.at(), 10ms);
+    EXPECT_EQ(d.remaining(), std::chrono::steady_clock::duration::zero());
+    EXPECT_EQ(d.trim(1s), std::chrono::steady_clock::duration::zero());
+}
+
+TEST(async_timeoutable_tests, expired_deadline_does_not_start_operation) {
+    asio::io_context ctx;
+
+    bool started = false;
+    auto async_op = [&](auto done) {
+        started = true;
+        done(std::error_code());
+    };
+
+    std::optional<std::error_code> result;
+    async_timeoutable(ctx, async_op)(deadline(std::chrono::steady_clock::now()),
+                                     [&](std::error_code ec) { result = ec; });
+
+    EXPECT_EQ(result, make_error_code(std::errc::timed_out));
+    EXPECT_FALSE(started);
+}
+
+TEST(async_timeoutable_tests, completion_and_timeout_race_on_thread_pool) {
+    // operations complete on worker threads about when their timeouts fire on io_context threads.
+    asio::io_context ctx;
+    asio::io_context workers_ctx;
+    auto workers_guard = asio::make_work_guard(workers_ctx);
+
+    std::atomic<int> cancelled{0};
+    auto async_op = [&workers_ctx, &cancelled](cancellation_token& token, int delay_us, auto done) {
+        token.impl = [&cancelled] { cancelled++; };
+        auto timer = std::make_shared<asio::steady_timer>(workers_ctx, std::chrono::microseconds(delay_us));
+        timer->async_wait([timer, done](std::error_code) { done(std::error_code(), 1); });
+    };
+
+    constexpr int ops_num = 2000;
+    std::atomic<int> succeeded{0}, timed_out{0};
+    std::vector<std::atomic<int>> done_calls(ops_num);
+    for (int i = 0; i < ops_num; ++i) {
+        // started from pool threads too, while other timeouts fire.
+        asio::post(ctx, [&, i] {
+            async_timeoutable(ctx, async_op)(1ms, 900 + i % 200, [&, i](std::error_code ec, int) {
+                done_calls[i]++;
+                (ec ? timed_out : succeeded)++;
+            });
+        });
+    }
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 2; ++i) {
+        threads.emplace_back([&workers_ctx] { workers_ctx.run(); });
+    }
+    for (int i = 0; i < 4; ++i) {
+        threads.emplace_back([&ctx] { ctx.run(); });
+    }
+    for (std::size_t i = 2; i < threads.size(); ++i) {
+        threads[i].join();
+    }
+    workers_guard.reset();
+    threads[0].join();
+    threads[1].join();
+
+    EXPECT_EQ(succeeded + timed_out, ops_num);
+    EXPECT_EQ(cancelled, timed_out);
+    for (auto& calls : done_calls) {
+        EXPECT_EQ(calls, 1);
+    }
+}
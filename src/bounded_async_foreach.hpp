@@ -1,66 +1,426 @@
 #pragma once
 
+#include "adaptive_limit.hpp"
+#include "deadline.hpp"
+
+#include <asio/execution/executor.hpp>
+#include <asio/is_executor.hpp>
+#include <asio/post.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
 #include <functional>
 #include <iostream>
+#include <iterator>
 #include <memory>
+#include <optional>
+#include <ranges>
 #include <system_error>
+#include <type_traits>
+#include <utility>
 
-template <typename Container, typename Callback, typename FinishCallback>
-void bounded_async_foreach(unsigned limit_n, Container c, Callback cb, FinishCallback finished_cb) {
-    if (limit_n == 0) {
-        finished_cb(make_error_code(std::errc::no_child_process));
-        return;
+namespace lsem::async {
+
+// Lazy input of bounded_async_foreach, e.g. lines of a file or pages of an API. next(handler) produces one item,
+// calling handler(std::error_code, std::optional<value_type>) inline or later; std::nullopt means there is nothing
+// more. Error stops iteration like an error of an item. next() is called again only after handler ran, and only when
+// there is a free worker for the item, so at most one item is buffered.
+//
+// Pulled item is owned by foreach only until cb returns: it is passed to cb as rvalue, so cb that needs it after
+// returning (in the operation it started) takes it by value.
+template <class Source>
+concept pull_source = requires(Source& s) {
+    typename Source::value_type;
+    s.next([](std::error_code, std::optional<typename Source::value_type>) {});
+};
+
+// Total cost of items bounded_async_foreach runs at once, e.g. bytes they hold in memory.
+struct cost_budget {
+    std::size_t total;
+};
+
+namespace details {
+
+// All sources have front()/pop() of an item that is ready() and not empty(), take() is front() as passed to cb.
+// fetch(on_ready) makes source ready again, it does nothing for ranges which are always ready.
+template <class Range>
+class range_source {
+   public:
+    explicit range_source(Range r) : m_range(std::move(r)), m_it(std::ranges::begin(m_range)) {}
+    // iterator points into own range.
+    range_source(const range_source&) = delete;
+    range_source& operator=(const range_source&) = delete;
+
+    bool ready() const { return true; }
+    template <class Handler>
+    void fetch(Handler&&) {}
+
+    bool empty() { return m_it == std::ranges::end(m_range); }
+    decltype(auto) front() { return *m_it; }
+    // items are not owned, they are lent to cb.
+    decltype(auto) take() { return *m_it; }
+    void pop() { ++m_it; }
+
+   private:
+    Range m_range;
+    std::ranges::iterator_t<Range> m_it;
+};
+
+template <class Source>
+class pulled_source {
+   public:
+    using value_type = typename Source::value_type;
+
+    explicit pulled_source(Source s) : m_source(std::move(s)) {}
+    // handler of pending next() refers to this.
+    pulled_source(const pulled_source&) = delete;
+    pulled_source& operator=(const pulled_source&) = delete;
+
+    bool ready() const { return m_item.has_value() || m_exhausted; }
+    template <class Handler>
+    void fetch(Handler on_ready) {
+        m_source.next([this, on_ready = std::move(on_ready)](std::error_code ec,
+                                                            std::optional<value_type> item) mutable {
+            if (item) {
+                m_item = std::move(item);
+            } else if (!ec) {
+                m_exhausted = true;
+            }
+            on_ready(ec);
+        });
+    }
+
+    bool empty() const { return m_exhausted; }
+    value_type& front() { return *m_item; }
+    // pulled item is dropped by pop() right after cb returns, so cb may move it away.
+    value_type&& take() { return std::move(*m_item); }
+    void pop() { m_item.reset(); }
+
+   private:
+    Source m_source;
+    std::optional<value_type> m_item;
+    bool m_exhausted = false;
+};
+
+template <class Input>
+using foreach_source_t = std::conditional_t<pull_source<Input>, pulled_source<Input>, range_source<Input>>;
+
+// How many items bounded_async_foreach runs at once. has_room(in_flight) is asked before fetching next item and
+// admits(item, in_flight) before starting it. start(item) returns a ticket that finish(ticket, ec) gets once item is
+// done.
+class fixed_limit {
+   public:
+    struct ticket {};
+
+    explicit fixed_limit(unsigned n) : m_n(n) {}
+
+    bool has_room(unsigned in_flight) const { return in_flight < m_n; }
+    template <class Item>
+    bool admits(const Item&, unsigned in_flight) const {
+        return has_room(in_flight);
+    }
+    template <class Item>
+    ticket start(const Item&) {
+        return {};
     }
+    void finish(ticket, std::error_code) {}
 
-    using iter_type = decltype(std::cbegin(c));
+   private:
+    unsigned m_n;
+};
+
+// feeds latency and outcome of every item to adaptive_limit, which may change between items.
+class adaptive_limiter {
+   public:
+    using ticket = std::chrono::steady_clock::time_point;
+
+    explicit adaptive_limiter(std::shared_ptr<adaptive_limit> limit) : m_limit(std::move(limit)) {}
+
+    bool has_room(unsigned in_flight) const { return in_flight < m_limit->limit(); }
+    template <class Item>
+    bool admits(const Item&, unsigned in_flight) const {
+        return has_room(in_flight);
+    }
+    template <class Item>
+    ticket start(const Item&) {
+        return std::chrono::steady_clock::now();
+    }
+    void finish(ticket started, std::error_code ec) {
+        m_limit->on_completed(std::chrono::steady_clock::now() - started, ec);
+    }
+
+   private:
+    std::shared_ptr<adaptive_limit> m_limit;
+};
+
+// admits items while their total cost fits into budget, item costing more than the whole budget runs alone. Items are
+// started in order, so the next one waits for enough cost to be freed even if a cheaper one follows it. Zero cost
+// counts as 1, so that free items cannot run in unbounded numbers.
+template <class CostFn>
+class cost_limiter {
+   public:
+    using ticket = std::size_t;
+
+    cost_limiter(std::size_t budget, CostFn cost_fn) : m_budget(budget), m_cost_fn(std::move(cost_fn)) {}
+
+    bool has_room(unsigned in_flight) const { return in_flight == 0 || m_in_flight_cost < m_budget; }
+    template <class Item>
+    bool admits(const Item& item, unsigned in_flight) {
+        // head item waiting for budget is asked again on every completion, its cost is computed once.
+        if (!m_head_cost) {
+            m_head_cost = std::max<std::size_t>(1, static_cast<std::size_t>(std::invoke(m_cost_fn, item)));
+        }
+        return in_flight == 0 || *m_head_cost <= m_budget - m_in_flight_cost;
+    }
+    // always follows admits() of the same item.
+    template <class Item>
+    ticket start(const Item&) {
+        const auto cost = *std::exchange(m_head_cost, std::nullopt);
+        m_in_flight_cost += cost;
+        return cost;
+    }
+    void finish(ticket cost, std::error_code) { m_in_flight_cost -= cost; }
+
+   private:
+    std::size_t m_budget;
+    CostFn m_cost_fn;
+    std::size_t m_in_flight_cost = 0;
+    std::optional<std::size_t> m_head_cost;
+};
+
+template <typename Limiter, typename Container, typename Callback, typename FinishCallback>
+void bounded_async_foreach_impl(Limiter limiter, Container c, Callback cb, FinishCallback finished_cb) {
+    using source_type = foreach_source_t<Container>;
     struct self_state {
-        Container c;
-        iter_type it;
+        source_type source;
         Callback cb;
-        unsigned free_workers;
-        const unsigned n_workers;
+        Limiter limiter;
+        unsigned in_flight = 0;
         FinishCallback finished_cb;
         std::error_code exec_result = std::error_code();
+        // no new items are started once set.
+        bool stopped = false;
+        // pull source is producing the next item.
+        bool fetching = false;
+        // set while process_next loop starts items. done called from inside cb (inline completion) only frees its
+        // worker then, and the loop goes on with the next item instead of recursing, so stack depth stays constant.
+        bool scheduling = false;
+        bool finished = false;
         std::function<void(std::shared_ptr<self_state>)> process_next;
 
-        self_state(Container c, Callback cb, unsigned n, FinishCallback finished_cb)
-            : c(std::move(c)),
-              it(std::cbegin(this->c)),
+        self_state(Container c, Callback cb, Limiter limiter, FinishCallback finished_cb)
+            : source(std::move(c)),
               cb(std::move(cb)),
-              free_workers(n),
-              n_workers(n),
+              limiter(std::move(limiter)),
               finished_cb(std::move(finished_cb)) {}
+
+        void fail(std::error_code ec) {
+            // first error sticks to state, other errors basically ignored,
+            // this targets practical use case for cancelling.
+            if (!exec_result) {
+                exec_result = ec;
+            }
+            stopped = true;
+        }
     };
 
-    auto self = std::make_shared<self_state>(std::move(c), std::move(cb), limit_n, std::move(finished_cb));
+    auto self = std::make_shared<self_state>(std::move(c), std::move(cb), std::move(limiter), std::move(finished_cb));
 
     self->process_next = [](std::shared_ptr<self_state> self) {
-        if (self->it != std::cend(self->c)) {
-            if (self->free_workers > 0) {
-                self->free_workers--;
-                self->cb(*self->it++, [self](std::error_code ec) {
-                    self->free_workers++;
+        if (self->scheduling) {
+            return;
+        }
+        self->scheduling = true;
+        while (!self->stopped && self->limiter.has_room(self->in_flight)) {
+            if (!self->source.ready()) {
+                if (self->fetching) {
+                    break;
+                }
+                self->fetching = true;
+                self->source.fetch([self](std::error_code ec) {
+                    self->fetching = false;
                     if (ec) {
-                        // first error sticks to state, other errors basically ignored,
-                        // this targets practical use case for cancelling.
-                        if (!self->exec_result) {
-                            self->exec_result = ec;
-                        }
-                        self->it = std::cend(self->c);
-                    } else {
-                        // success, just go on to next one.
+                        self->fail(ec);
                     }
                     self->process_next(self);
                 });
-                self->process_next(self);
+                // item may have been produced inline.
+                continue;
             }
-        } else {
-            // last element tries to find new work, non-last just fade out.
-            if (self->free_workers == self->n_workers) {
-                self->finished_cb(self->exec_result);
+            if (self->source.empty() || !self->limiter.admits(self->source.front(), self->in_flight)) {
+                break;
             }
+            auto ticket = self->limiter.start(self->source.front());
+            self->in_flight++;
+            // nothing else touches source while cb runs, so item stays valid until it returns.
+            self->cb(self->source.take(), [self, ticket](std::error_code ec) {
+                self->in_flight--;
+                self->limiter.finish(ticket, ec);
+                if (ec) {
+                    self->fail(ec);
+                } else {
+                    // success, just go on to next one.
+                }
+                self->process_next(self);
+            });
+            self->source.pop();
+        }
+        self->scheduling = false;
+
+        // last element tries to find new work, non-last just fade out.
+        const bool exhausted = self->stopped || (self->source.ready() && self->source.empty());
+        if (exhausted && !self->fetching && self->in_flight == 0 && !self->finished) {
+            self->finished = true;
+            self->finished_cb(self->exec_result);
         }
     };
 
     self->process_next(self);
 }
+
+}  // namespace details
+
+}  // namespace lsem::async
+
+// Calls cb(item, done) for every item of c, at most limit_n at once, and finished_cb(ec) once all are done. The first
+// error passed to done stops starting new items and is passed to finished_cb.
+//
+// c is taken by value: container (move it in to avoid a copy), view (std::views::all(v) refers to v without copying
+// it, which then has to outlive iteration) or lsem::async::pull_source producing items lazily. Items of containers and
+// views stay valid until iteration ends, pulled ones only until cb returns, unless cb takes them by value.
+template <typename Container, typename Callback, typename FinishCallback>
+void bounded_async_foreach(unsigned limit_n, Container c, Callback cb, FinishCallback finished_cb) {
+    if (limit_n == 0) {
+        finished_cb(make_error_code(std::errc::no_child_process));
+        return;
+    }
+    lsem::async::details::bounded_async_foreach_impl(lsem::async::details::fixed_limit(limit_n), std::move(c),
+                                                     std::move(cb), std::move(finished_cb));
+}
+
+// Same, but the number of items at once follows limit, which learns it from latency and errors of items. limit may be
+// shared by several runs over the same downstream, so that what one learned the next one starts from.
+template <typename Container, typename Callback, typename FinishCallback>
+void bounded_async_foreach(std::shared_ptr<lsem::async::adaptive_limit> limit,
+                           Container c,
+                           Callback cb,
+                           FinishCallback finished_cb) {
+    lsem::async::details::bounded_async_foreach_impl(lsem::async::details::adaptive_limiter(std::move(limit)),
+                                                     std::move(c), std::move(cb), std::move(finished_cb));
+}
+
+// Same, but items differ in size: cost_fn(item) tells what item costs (bytes, estimated CPU), and items run at once
+// cost budget.total at most. Item costing more than that runs alone, once everything before it is done. Bounds peak
+// memory of pipelines whose items range from kilobytes to gigabytes, where a fixed number of items would either waste
+// memory or starve throughput.
+template <typename Container, typename CostFn, typename Callback, typename FinishCallback>
+void bounded_async_foreach(
+    lsem::async::cost_budget budget, Container c, CostFn cost_fn, Callback cb, FinishCallback finished_cb) {
+    if (budget.total == 0) {
+        finished_cb(make_error_code(std::errc::no_child_process));
+        return;
+    }
+    lsem::async::details::bounded_async_foreach_impl(
+        lsem::async::details::cost_limiter<CostFn>(budget.total, std::move(cost_fn)), std::move(c), std::move(cb),
+        std::move(finished_cb));
+}
+
+// Same, for items in [first, last), which are not copied and have to outlive iteration.
+template <std::input_iterator Iterator,
+          std::sentinel_for<Iterator> Sentinel,
+          typename Callback,
+          typename FinishCallback>
+void bounded_async_foreach(unsigned limit_n, Iterator first, Sentinel last, Callback cb, FinishCallback finished_cb) {
+    bounded_async_foreach(limit_n, std::ranges::subrange(std::move(first), std::move(last)), std::move(cb),
+                          std::move(finished_cb));
+}
+
+// Same, but no item is started once deadline has passed: finished_cb gets std::errc::timed_out (unless some item
+// failed before), after items in flight are done. cb is called as cb(item, deadline, done) so that it can pass
+// deadline down to what it starts.
+template <typename Container, typename Callback, typename FinishCallback>
+void bounded_async_foreach(
+    unsigned limit_n, Container c, Callback cb, FinishCallback finished_cb, lsem::async::deadline deadline) {
+    auto cb_within_deadline = [cb = std::move(cb), deadline](auto&& item, auto done) mutable {
+        if (deadline.expired()) {
+            done(make_error_code(std::errc::timed_out));
+            return;
+        }
+        cb(std::forward<decltype(item)>(item), deadline, std::move(done));
+    };
+    bounded_async_foreach(limit_n, std::move(c), std::move(cb_within_deadline), std::move(finished_cb));
+}
+
+// Same, but for CPU heavy cb: items are dispatched onto executor ex, e.g. of asio::thread_pool or io_context run by
+// several threads, so up to limit_n of them are processed in parallel. Items are claimed with an atomic cursor, so
+// Container has to be random access. cb is called concurrently from threads of ex and has to be safe for that, done
+// may be called from any thread. finished_cb is called by whichever thread finishes the last item.
+template <typename Executor, typename Container, typename Callback, typename FinishCallback>
+    requires(asio::execution::is_executor<Executor>::value || asio::is_executor<Executor>::value)
+void bounded_async_foreach(const Executor& ex, unsigned limit_n, Container c, Callback cb, FinishCallback finished_cb) {
+    static_assert(std::random_access_iterator<decltype(std::cbegin(c))>, "random access container expected");
+
+    if (limit_n == 0) {
+        finished_cb(make_error_code(std::errc::no_child_process));
+        return;
+    }
+
+    const auto items_n = static_cast<std::size_t>(std::size(c));
+    const auto lanes_n = static_cast<unsigned>(std::min<std::size_t>(limit_n, items_n));
+    if (lanes_n == 0) {
+        finished_cb(std::error_code());
+        return;
+    }
+
+    // every lane takes next item once previous one is done, lanes_n items are in flight at most.
+    struct self_state {
+        Executor ex;
+        Container c;
+        Callback cb;
+        FinishCallback finished_cb;
+        std::atomic<std::size_t> cursor{0};
+        std::atomic<unsigned> running_lanes;
+        std::atomic<bool> failed{false};
+        // written once by the first failed item, read by the last lane.
+        std::error_code exec_result = std::error_code();
+        std::function<void(std::shared_ptr<self_state>)> run_lane;
+
+        self_state(const Executor& ex, Container c, Callback cb, FinishCallback finished_cb, unsigned lanes_n)
+            : ex(ex),
+              c(std::move(c)),
+              cb(std::move(cb)),
+              finished_cb(std::move(finished_cb)),
+              running_lanes(lanes_n) {}
+    };
+
+    auto self = std::make_shared<self_state>(ex, std::move(c), std::move(cb), std::move(finished_cb), lanes_n);
+
+    self->run_lane = [](std::shared_ptr<self_state> self) {
+        const auto items_n = static_cast<std::size_t>(std::size(self->c));
+        const auto i = self->failed.load(std::memory_order_acquire)
+                           ? items_n
+                           : self->cursor.fetch_add(1, std::memory_order_relaxed);
+        if (i >= items_n) {
+            // lane fades out, the last one reports.
+            if (self->running_lanes.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                self->finished_cb(self->exec_result);
+            }
+            return;
+        }
+        asio::post(self->ex, [self, i] {
+            self->cb(std::cbegin(self->c)[i], [self](std::error_code ec) {
+                // first error sticks, no new items are claimed after it.
+                if (ec && !self->failed.exchange(true, std::memory_order_acq_rel)) {
+                    self->exec_result = ec;
+                }
+                self->run_lane(self);
+            });
+        });
+    };
+
+    for (unsigned lane = 0; lane < lanes_n; ++lane) {
+        self->run_lane(self);
+    }
+}
@@ -3,9 +3,19 @@
 
 #include <algorithm>
 #include <asio/io_context.hpp>
+#include <asio/post.hpp>
 #include <asio/steady_timer.hpp>
+#include <asio/thread_pool.hpp>
+#include <atomic>
 #include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <optional>
+#include <ranges>
 #include <set>
+#include <string>
+#include <thread>
 
 using namespace std::chrono_literals;
 
@@ -208,6 +218,60 @@ TEST(bounded_async_foreach, synchronous_calls_test) {
     EXPECT_EQ(done_invocations, input);
 }
 
+TEST(bounded_async_foreach, synchronous_calls_keep_stack_flat) {
+    // every item completes inline, recursing per item would overflow the stack.
+    std::vector<int> input(1000000, 1);
+    long long sum = 0;
+    int finish_calls = 0;
+    bounded_async_foreach(
+        4, std::move(input),
+        [&sum](int element, auto done) {
+            sum += element;
+            done(std::error_code());
+        },
+        [&](std::error_code ec) {
+            EXPECT_FALSE(ec);
+            finish_calls++;
+        });
+
+    EXPECT_EQ(finish_calls, 1);
+    EXPECT_EQ(sum, 1000000);
+}
+
+TEST(bounded_async_foreach, mixed_synchronous_and_async_calls) {
+    asio::io_context ctx;
+
+    std::vector<int> input(100);
+    std::iota(input.begin(), input.end(), 0);
+    std::vector<int> started;
+    int n_running = 0;
+    int n_running_max = 0;
+    int finish_calls = 0;
+    bounded_async_foreach(
+        3, input,
+        [&](int item, auto done) {
+            started.push_back(item);
+            if (item % 3 == 0) {
+                done(std::error_code());
+                return;
+            }
+            n_running_max = std::max(n_running_max, ++n_running);
+            async_sleep(ctx, 1ms, [&n_running, done] {
+                n_running--;
+                done(std::error_code());
+            });
+        },
+        [&](std::error_code ec) {
+            EXPECT_FALSE(ec);
+            finish_calls++;
+        });
+    ctx.run();
+
+    EXPECT_EQ(started, input);
+    EXPECT_LE(n_running_max, 3);
+    EXPECT_EQ(finish_calls, 1);
+}
+
 TEST(bounded_async_foreach, after_cancel_no_new_starts_test) {
     asio::io_context ctx;
 
@@ -398,3 +462,357 @@ TEST(bounded_async_foreach, finished_callback_gets_destructed) {
 
     EXPECT_EQ(resource.use_count(), 1);
 }
+
+TEST(bounded_async_foreach, no_new_starts_after_deadline) {
+    asio::io_context ctx;
+
+    std::vector<int> input = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10};
+    std::vector<int> started;
+    std::optional<std::error_code> result;
+
+    // two items at a time every 40ms, so 6 of them start before 100ms deadline.
+    const auto d = lsem::async::deadline::after(100ms);
+    bounded_async_foreach(
+        2, input,
+        [&](int item, lsem::async::deadline item_deadline, auto done_cb) {
+            EXPECT_EQ(item_deadline.at(), d.at());
+            started.push_back(item);
+            async_sleep(ctx, 40ms, [done_cb = std::move(done_cb)] { done_cb(std::error_code()); });
+        },
+        [&](std::error_code ec) { result = ec; }, d);
+    ctx.run();
+
+    EXPECT_EQ(result, make_error_code(std::errc::timed_out));
+    EXPECT_EQ(started, std::vector<int>({1, 2, 3, 4, 5, 6}));
+}
+
+TEST(bounded_async_foreach, thread_pool_processes_items_in_parallel) {
+    asio::thread_pool pool(4);
+
+    std::vector<int> input(200);
+    std::iota(input.begin(), input.end(), 0);
+    std::vector<std::atomic<int>> processed(input.size());
+    std::atomic<int> n_running{0}, n_running_max{0};
+    std::mutex threads_mutex;
+    std::set<std::thread::id> threads;
+    std::atomic<int> finish_calls{0};
+    std::error_code result;
+
+    bounded_async_foreach(
+        pool.get_executor(), 3, input,
+        [&](int item, auto done_cb) {
+            const int running = ++n_running;
+            int max = n_running_max;
+            while (running > max && !n_running_max.compare_exchange_weak(max, running)) {
+            }
+            {
+                std::lock_guard lock(threads_mutex);
+                threads.insert(std::this_thread::get_id());
+            }
+            std::this_thread::sleep_for(100us);
+            processed[item]++;
+            n_running--;
+            done_cb(std::error_code());
+        },
+        [&](std::error_code ec) {
+            result = ec;
+            finish_calls++;
+        });
+    pool.join();
+
+    EXPECT_EQ(finish_calls, 1);
+    EXPECT_FALSE(result);
+    EXPECT_LE(n_running_max, 3);
+    EXPECT_GT(threads.size(), 1);
+    for (auto& p : processed) {
+        EXPECT_EQ(p, 1);
+    }
+}
+
+TEST(bounded_async_foreach, thread_pool_stops_on_first_error) {
+    asio::thread_pool pool(4);
+
+    std::vector<int> input(1000);
+    std::iota(input.begin(), input.end(), 0);
+    std::atomic<int> started{0};
+    std::optional<std::error_code> result;
+
+    bounded_async_foreach(
+        pool.get_executor(), 4, input,
+        [&](int item, auto done_cb) {
+            started++;
+            done_cb(item == 10 ? make_error_code(std::errc::io_error) : std::error_code());
+        },
+        [&](std::error_code ec) { result = ec; });
+    pool.join();
+
+    EXPECT_EQ(result, make_error_code(std::errc::io_error));
+    EXPECT_LT(started, 1000);
+}
+
+TEST(bounded_async_foreach, iterator_pair_is_not_copied) {
+    asio::io_context ctx;
+
+    std::vector<std::string> input = make_sequence(10);
+    std::vector<const std::string*> addresses;
+    bool finish_called = false;
+    bounded_async_foreach(
+        2, input.begin() + 2, input.end() - 2,
+        [&](const std::string& item, auto done) {
+            addresses.push_back(&item);
+            async_sleep(ctx, 1ms, [done] { done(std::error_code()); });
+        },
+        [&](std::error_code ec) {
+            EXPECT_FALSE(ec);
+            finish_called = true;
+        });
+    ctx.run();
+
+    EXPECT_TRUE(finish_called);
+    ASSERT_EQ(addresses.size(), 6);
+    for (std::size_t i = 0; i < addresses.size(); ++i) {
+        EXPECT_EQ(addresses[i], &input[i + 2]);
+    }
+}
+
+TEST(bounded_async_foreach, range_view) {
+    std::vector<int> processed;
+    bool finish_called = false;
+    bounded_async_foreach(
+        3, std::views::iota(0, 20) | std::views::filter([](int i) { return i % 5 == 0; }),
+        [&](int item, auto done) {
+            processed.push_back(item);
+            done(std::error_code());
+        },
+        [&](std::error_code ec) {
+            EXPECT_FALSE(ec);
+            finish_called = true;
+        });
+
+    EXPECT_TRUE(finish_called);
+    EXPECT_EQ(processed, std::vector<int>({0, 5, 10, 15}));
+}
+
+namespace {
+// produces 0, 1, ..., n - 1 asynchronously, counting how many items are produced but not yet taken.
+struct async_counter_source {
+    using value_type = int;
+
+    template <class Handler>
+    void next(Handler&& handler) {
+        EXPECT_FALSE(*pending) << "next called before previous one completed";
+        *pending = true;
+        asio::post(*ctx, [this_copy = *this, handler = std::forward<Handler>(handler)]() mutable {
+            *this_copy.pending = false;
+            if (*this_copy.produced == this_copy.n) {
+                handler(std::error_code(), std::nullopt);
+                return;
+            }
+            if (*this_copy.produced == this_copy.fail_at) {
+                handler(make_error_code(std::errc::io_error), std::nullopt);
+                return;
+            }
+            handler(std::error_code(), (*this_copy.produced)++);
+        });
+    }
+
+    asio::io_context* ctx;
+    int n;
+    int fail_at = -1;
+    std::shared_ptr<int> produced = std::make_shared<int>(0);
+    std::shared_ptr<bool> pending = std::make_shared<bool>(false);
+};
+}  // namespace
+
+TEST(bounded_async_foreach, pull_source_is_consumed_lazily) {
+    asio::io_context ctx;
+
+    async_counter_source source{.ctx = &ctx, .n = 50};
+    auto produced = source.produced;
+    std::vector<int> started;
+    int n_running = 0;
+    int n_running_max = 0;
+    std::optional<std::error_code> result;
+    bounded_async_foreach(
+        4, source,
+        [&](int item, auto done) {
+            started.push_back(item);
+            // only the item being started is buffered.
+            EXPECT_EQ(*produced, item + 1);
+            n_running_max = std::max(n_running_max, ++n_running);
+            async_sleep(ctx, 1ms, [&n_running, done] {
+                n_running--;
+                done(std::error_code());
+            });
+        },
+        [&](std::error_code ec) { result = ec; });
+    ctx.run();
+
+    EXPECT_EQ(result, std::error_code());
+    std::vector<int> expected(50);
+    std::iota(expected.begin(), expected.end(), 0);
+    EXPECT_EQ(started, expected);
+    EXPECT_EQ(n_running_max, 4);
+}
+
+TEST(bounded_async_foreach, pull_source_error_stops_iteration) {
+    asio::io_context ctx;
+
+    std::vector<int> started;
+    std::optional<std::error_code> result;
+    bounded_async_foreach(
+        2, async_counter_source{.ctx = &ctx, .n = 50, .fail_at = 5},
+        [&](int item, auto done) {
+            started.push_back(item);
+            async_sleep(ctx, 1ms, [done] { done(std::error_code()); });
+        },
+        [&](std::error_code ec) { result = ec; });
+    ctx.run();
+
+    EXPECT_EQ(result, make_error_code(std::errc::io_error));
+    EXPECT_EQ(started, std::vector<int>({0, 1, 2, 3, 4}));
+}
+
+namespace {
+// produces move-only items inline.
+struct unique_string_source {
+    using value_type = std::unique_ptr<std::string>;
+
+    template <class Handler>
+    void next(Handler&& handler) {
+        if (produced == n) {
+            handler(std::error_code(), std::nullopt);
+            return;
+        }
+        handler(std::error_code(), std::make_unique<std::string>(std::to_string(produced++)));
+    }
+
+    int n;
+    int produced = 0;
+};
+}  // namespace
+
+TEST(bounded_async_foreach, pulled_item_may_be_owned_by_callback) {
+    asio::io_context ctx;
+
+    std::vector<std::string> processed;
+    std::optional<std::error_code> result;
+    bounded_async_foreach(
+        2, unique_string_source{.n = 5},
+        // foreach drops its copy once cb returns, item lives on in the operation.
+        [&](std::unique_ptr<std::string> item, auto done) {
+            async_sleep(ctx, 1ms, [&, item = std::move(item), done] {
+                processed.push_back(*item);
+                done(std::error_code());
+            });
+        },
+        [&](std::error_code ec) { result = ec; });
+    ctx.run();
+
+    EXPECT_EQ(result, std::error_code());
+    EXPECT_EQ(processed, std::vector<std::string>({"0", "1", "2", "3", "4"}));
+}
+
+TEST(bounded_async_foreach, cost_budget_is_respected) {
+    asio::io_context ctx;
+
+    const std::vector<std::size_t> sizes = {3, 1, 4, 1, 5, 9, 2, 6, 5, 3, 5, 8, 9, 7, 9};
+    std::size_t cost_in_flight = 0, cost_in_flight_max = 0;
+    int n_running = 0, n_running_max = 0;
+    std::vector<std::size_t> started;
+    std::optional<std::error_code> result;
+    bounded_async_foreach(
+        lsem::async::cost_budget{.total = 10}, sizes, [](std::size_t size) { return size; },
+        [&](std::size_t size, auto done) {
+            started.push_back(size);
+            cost_in_flight += size;
+            cost_in_flight_max = std::max(cost_in_flight_max, cost_in_flight);
+            n_running_max = std::max(n_running_max, ++n_running);
+            async_sleep(ctx, std::chrono::milliseconds(size), [&, size, done] {
+                cost_in_flight -= size;
+                n_running--;
+                done(std::error_code());
+            });
+        },
+        [&](std::error_code ec) { result = ec; });
+    ctx.run();
+
+    EXPECT_EQ(result, std::error_code());
+    // in order, cheap items do not overtake expensive one waiting for budget.
+    EXPECT_EQ(started, sizes);
+    EXPECT_LE(cost_in_flight_max, 10);
+    EXPECT_GT(n_running_max, 1);
+}
+
+TEST(bounded_async_foreach, oversized_item_runs_alone) {
+    asio::io_context ctx;
+
+    int n_running = 0;
+    std::vector<int> running_with_big;
+    std::optional<std::error_code> result;
+    bounded_async_foreach(
+        lsem::async::cost_budget{.total = 10}, std::vector<int>{2, 2, 100, 2, 2}, [](int size) { return size; },
+        [&](int size, auto done) {
+            n_running++;
+            if (size == 100) {
+                running_with_big.push_back(n_running);
+            }
+            async_sleep(ctx, 1ms, [&, done] {
+                n_running--;
+                done(std::error_code());
+            });
+        },
+        [&](std::error_code ec) { result = ec; });
+    ctx.run();
+
+    EXPECT_EQ(result, std::error_code());
+    EXPECT_EQ(running_with_big, std::vector<int>({1}));
+}
+
+TEST(bounded_async_foreach, cost_is_computed_once_per_item) {
+    asio::io_context ctx;
+
+    int cost_calls = 0;
+    std::optional<std::error_code> result;
+    bounded_async_foreach(
+        lsem::async::cost_budget{.total = 10}, std::vector<int>{6, 6, 6, 6},
+        [&](int size) {
+            cost_calls++;
+            return size;
+        },
+        [&](int, auto done) { async_sleep(ctx, 1ms, [done] { done(std::error_code()); }); },
+        [&](std::error_code ec) { result = ec; });
+    ctx.run();
+
+    EXPECT_EQ(result, std::error_code());
+    EXPECT_EQ(cost_calls, 4);
+}
+
+TEST(bounded_async_foreach, zero_cost_items_are_bounded) {
+    asio::io_context ctx;
+
+    int n_running = 0, n_running_max = 0;
+    std::optional<std::error_code> result;
+    bounded_async_foreach(
+        lsem::async::cost_budget{.total = 3}, std::vector<int>(20), [](int) { return 0; },
+        [&](int, auto done) {
+            n_running_max = std::max(n_running_max, ++n_running);
+            async_sleep(ctx, 1ms, [&, done] {
+                n_running--;
+                done(std::error_code());
+            });
+        },
+        [&](std::error_code ec) { result = ec; });
+    ctx.run();
+
+    EXPECT_EQ(result, std::error_code());
+    EXPECT_EQ(n_running_max, 3);
+}
+
+TEST(bounded_async_foreach, zero_cost_budget_test) {
+    std::optional<std::error_code> result;
+    bounded_async_foreach(
+        lsem::async::cost_budget{.total = 0}, std::vector<int>{1}, [](int) { return 1; },
+        [](int, auto done) { done(std::error_code()); }, [&](std::error_code ec) { result = ec; });
+    EXPECT_EQ(result, make_error_code(std::errc::no_child_process));
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <function2/function2.hpp>
+
+namespace lsem::async {
+
+// token is a thing that allow to cancel async operation.
+struct cancellation_token {
+    ~cancellation_token() {
+        if (impl) {
+            impl();
+        }
+    }
+
+    void cancel() {
+        if (impl) {
+            impl();
+            impl = nullptr;
+        }
+    }
+
+    // TODO: cancel_async(done)?
+
+    // implementors of async functions can hook they implementation specific
+    // cancellation mechanism to be invoked when user wants to cancel something.
+    // implementation can put anything callable into impl and that will be invoked either by calling function
+    // or in destrcutor automatically.
+    fu2::unique_function<void()> impl;
+};
+
+}  // namespace lsem::async
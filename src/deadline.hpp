@@ -0,0 +1,50 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+
+namespace lsem::async {
+
+// Absolute point in time by which the whole operation, including everything it starts, has to be done. Unlike
+// relative timeouts, which give every nested call a fresh budget, one deadline passed down to children (or a sooner()
+// one derived from it) keeps the total within what the caller is going to wait for. async_timeoutable accepts it in
+// place of timeout, async_retry in its opts and bounded_async_foreach as the last argument; all of them refuse to
+// start work once it has passed and report std::errc::timed_out instead.
+//
+// Default constructed deadline never expires.
+class deadline {
+   public:
+    using clock = std::chrono::steady_clock;
+
+    constexpr deadline() = default;
+    explicit constexpr deadline(clock::time_point at) : m_at(at) {}
+
+    static deadline after(clock::duration timeout) { return deadline(clock::now() + timeout); }
+    static constexpr deadline never() { return deadline(); }
+
+    clock::time_point at() const { return m_at; }
+    bool unbounded() const { return m_at == clock::time_point::max(); }
+    bool expired() const { return !unbounded() && clock::now() >= m_at; }
+
+    // zero once expired, duration::max() when unbounded.
+    clock::duration remaining() const {
+        if (unbounded()) {
+            return clock::duration::max();
+        }
+        return std::max(clock::duration::zero(), m_at - clock::now());
+    }
+
+    // timeout of a child operation trimmed to what is left of the budget.
+    clock::duration trim(clock::duration timeout) const { return std::min(timeout, remaining()); }
+
+    // deadline of a child operation that should not take longer than timeout either.
+    deadline sooner(clock::duration timeout) const { return deadline(std::min(m_at, clock::now() + timeout)); }
+
+    // whether something taking at least `d` (e.g. pause before retry) can still finish in time.
+    bool allows(clock::duration d) const { return unbounded() || d < remaining(); }
+
+   private:
+    clock::time_point m_at = clock::time_point::max();
+};
+
+}  // namespace lsem::async
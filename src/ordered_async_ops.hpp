@@ -1,10 +1,10 @@
 #pragma once
+#include <algorithm>
 #include <asio/io_context.hpp>
 #include <asio/post.hpp>
 #include <functional>
 #include <memory>
 #include <vector>
-#include <iostream>
 
 namespace details {
 class ordered_async_ops_impl : public std::enable_shared_from_this<ordered_async_ops_impl> {
@@ -43,14 +43,6 @@ class ordered_async_ops_impl : public std::enable_shared_from_this<ordered_async
         if (execpted_order.size() > 1) {
             execpted_order.resize(execpted_order.size() - 1);
         }
-        std::cout << "expected:\n";
-        for (auto x : execpted_order) {
-            std::cout << x << "\n";
-        }
-        std::cout << "actual:\n";
-        for (auto x : actual_order) {
-            std::cout << x << "\n";
-        }
         return execpted_order == actual_order;
     }
 
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <new>
+
+namespace lsem::async {
+
+namespace details {
+
+// Freed small blocks of the calling thread, one free list per 16 byte size class. Blocks come from operator new, so
+// a block allocated on one thread may be freed to the cache of another one. Kept trivially destructible, so it stays
+// usable while other thread locals are destroyed; blocks it holds are given back by block_cache_guard.
+class block_cache {
+    struct block {
+        block* next;
+    };
+
+   public:
+    static constexpr std::size_t granularity = __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+    static constexpr std::size_t classes = 32;
+    static constexpr std::size_t max_cached = 64;
+
+    static void* allocate(std::size_t n) {
+        const auto c = class_of(n);
+        if (c >= classes) {
+            return ::operator new(n);
+        }
+        auto& cache = local();
+        if (auto* b = cache.m_free[c]) {
+            cache.m_free[c] = b->next;
+            cache.m_cached[c]--;
+            return b;
+        }
+        if (!cache.m_disabled) {
+            guard();
+        }
+        // always whole class, block may end up in a cache of another thread.
+        return ::operator new((c + 1) * granularity);
+    }
+
+    static void deallocate(void* p, std::size_t n) noexcept {
+        const auto c = class_of(n);
+        auto& cache = local();
+        if (c >= classes || cache.m_disabled || cache.m_cached[c] == max_cached) {
+            ::operator delete(p);
+            return;
+        }
+        // thread may only ever free blocks of others.
+        guard();
+        auto* b = static_cast<block*>(p);
+        b->next = cache.m_free[c];
+        cache.m_free[c] = b;
+        cache.m_cached[c]++;
+    }
+
+    static std::size_t cached() {
+        std::size_t total = 0;
+        for (auto n : local().m_cached) {
+            total += n;
+        }
+        return total;
+    }
+
+   private:
+    struct block_cache_guard {
+        ~block_cache_guard() { local().release(); }
+    };
+
+    static block_cache& local() {
+        thread_local block_cache cache;
+        return cache;
+    }
+
+    static std::size_t class_of(std::size_t n) { return n == 0 ? 0 : (n - 1) / granularity; }
+
+    // registers release of cached blocks at thread exit.
+    static void guard() { thread_local block_cache_guard guard; }
+
+    void release() {
+        m_disabled = true;
+        for (std::size_t c = 0; c < classes; ++c) {
+            while (auto* b = m_free[c]) {
+                m_free[c] = b->next;
+                ::operator delete(b);
+            }
+            m_cached[c] = 0;
+        }
+    }
+
+    std::array<block*, classes> m_free{};
+    std::array<std::size_t, classes> m_cached{};
+    bool m_disabled = false;
+};
+
+}  // namespace details
+
+// Allocator of state of async_timeoutable and async_retry calls. Blocks up to 512 bytes are recycled through a thread
+// local free list instead of going to the heap every time, like asio does for its handlers. Threads running an
+// io_context reuse state of their previous operations, so steady flow of calls does not allocate at all. Stateless,
+// any instance may free what another one allocated.
+template <class T = void>
+class pooled_allocator {
+   public:
+    using value_type = T;
+
+    pooled_allocator() noexcept = default;
+    template <class U>
+    pooled_allocator(const pooled_allocator<U>&) noexcept {}
+
+    T* allocate(std::size_t n) {
+        if constexpr (alignof(T) > details::block_cache::granularity) {
+            return std::allocator<T>{}.allocate(n);
+        } else {
+            return static_cast<T*>(details::block_cache::allocate(n * sizeof(T)));
+        }
+    }
+
+    void deallocate(T* p, std::size_t n) noexcept {
+        if constexpr (alignof(T) > details::block_cache::granularity) {
+            std::allocator<T>{}.deallocate(p, n);
+        } else {
+            details::block_cache::deallocate(p, n * sizeof(T));
+        }
+    }
+
+    template <class U>
+    bool operator==(const pooled_allocator<U>&) const noexcept {
+        return true;
+    }
+};
+
+}  // namespace lsem::async
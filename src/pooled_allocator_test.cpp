@@ -0,0 +1,101 @@
+#include "pooled_allocator.hpp"
+#include "async_retry.hpp"
+#include "async_timeoutable.hpp"
+
+#include <asio/io_context.hpp>
+#include <asio/post.hpp>
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <set>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono_literals;
+using namespace lsem::async;
+
+namespace {
+struct payload {
+    char data[100];
+};
+}  // namespace
+
+TEST(pooled_allocator_tests, freed_block_is_reused) {
+    pooled_allocator<payload> alloc;
+
+    auto* p1 = alloc.allocate(1);
+    alloc.deallocate(p1, 1);
+    auto* p2 = alloc.allocate(1);
+    EXPECT_EQ(p1, p2);
+
+    // other types of the same size class share blocks.
+    alloc.deallocate(p2, 1);
+    auto* p3 = pooled_allocator<char>{}.allocate(sizeof(payload));
+    EXPECT_EQ(static_cast<void*>(p3), static_cast<void*>(p2));
+    pooled_allocator<char>{}.deallocate(p3, sizeof(payload));
+}
+
+TEST(pooled_allocator_tests, large_blocks_are_not_cached) {
+    const auto cached_before = details::block_cache::cached();
+
+    pooled_allocator<char> alloc;
+    auto* p = alloc.allocate(4096);
+    alloc.deallocate(p, 4096);
+    EXPECT_EQ(details::block_cache::cached(), cached_before);
+}
+
+TEST(pooled_allocator_tests, block_may_be_freed_on_another_thread) {
+    pooled_allocator<payload> alloc;
+
+    std::vector<payload*> blocks;
+    for (int i = 0; i < 10; ++i) {
+        blocks.push_back(alloc.allocate(1));
+    }
+    std::thread([&] {
+        for (auto* b : blocks) {
+            alloc.deallocate(b, 1);
+        }
+        // given back to the heap at thread exit.
+        EXPECT_GE(details::block_cache::cached(), 10);
+    }).join();
+}
+
+TEST(pooled_allocator_tests, async_timeoutable_recycles_state) {
+    asio::io_context ctx;
+
+    auto async_op = [&ctx](int v, auto done) { asio::post(ctx, [v, done] { done(std::error_code(), v); }); };
+
+    // state of the first call is reused by the second one.
+    std::set<const void*> states;
+    auto run_once = [&] {
+        async_timeoutable(ctx, async_op)(1s, 1, [&](std::error_code ec, int r) { EXPECT_EQ(r, 1); });
+        ctx.run();
+        ctx.restart();
+    };
+    run_once();
+    const auto cached = details::block_cache::cached();
+    EXPECT_GT(cached, 0);
+    run_once();
+    EXPECT_EQ(details::block_cache::cached(), cached);
+}
+
+TEST(pooled_allocator_tests, allocator_is_pluggable) {
+    asio::io_context ctx;
+
+    auto async_op = [&ctx](int v, auto done) { asio::post(ctx, [v, done] { done(std::error_code(), v); }); };
+
+    std::optional<int> timeoutable_result, retry_result;
+    async_timeoutable<std::allocator<void>>(ctx, async_op)(1s, 1, [&](std::error_code ec, int r) {
+        timeoutable_result = r;
+    });
+    async_retry<std::allocator<void>>(ctx, async_op, {.attempts = 2})(2, [&](std::error_code ec, int r) {
+        retry_result = r;
+    });
+    ctx.run();
+
+    EXPECT_EQ(timeoutable_result, 1);
+    EXPECT_EQ(retry_result, 2);
+}
@@ -0,0 +1,229 @@
+#pragma once
+
+#include <asio/error.hpp>
+#include <asio/io_context.hpp>
+#include <asio/post.hpp>
+#include <asio/steady_timer.hpp>
+
+#include <function2/function2.hpp>
+
+#include <bit>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <system_error>
+#include <tuple>
+#include <utility>
+
+namespace lsem::async {
+
+// Lets timers that do not need exact precision share wakeups. Expiration of timeout d is delayed to the next
+// multiple of granularity, which is the largest power of two nanoseconds not exceeding d * slack. So timer fires
+// within [d, d * (1 + slack)] and all timers whose deadlines round to the same point share one steady_timer (one
+// heap entry, one timerfd update, one dispatch). Power of two granularities line up, so timers of different
+// durations coalesce too.
+//
+// Not thread safe, to be used from the thread(s) running its io_context serially. Must outlive timers using it.
+class timer_coalescer {
+    struct waiter_link {
+        waiter_link() : prev(this), next(this) {}
+        waiter_link(const waiter_link&) = delete;
+        waiter_link& operator=(const waiter_link&) = delete;
+
+        bool linked() const { return next != this; }
+
+        void unlink() {
+            prev->next = next;
+            next->prev = prev;
+            prev = next = this;
+        }
+
+        void push_back(waiter_link& l) {
+            l.prev = prev;
+            l.next = this;
+            prev->next = &l;
+            prev = &l;
+        }
+
+        waiter_link* prev;
+        waiter_link* next;
+    };
+
+    struct bucket {
+        explicit bucket(asio::io_context& ctx, std::uint64_t id) : timer(ctx), id(id) {}
+
+        asio::steady_timer timer;
+        waiter_link waiters;
+        const std::uint64_t id;
+    };
+
+    using buckets_type = std::map<std::chrono::steady_clock::time_point, bucket>;
+
+   public:
+    using duration = std::chrono::steady_clock::duration;
+    using handler_type = fu2::unique_function<void(std::error_code)>;
+
+    // One pending wait, owned by the user. Destroying armed waiter drops its wait without calling handler.
+    class waiter : private waiter_link {
+       public:
+        waiter() = default;
+        ~waiter() {
+            if (m_coalescer) {
+                m_coalescer->discard(*this);
+            }
+        }
+
+        bool armed() const { return linked(); }
+
+       private:
+        friend class timer_coalescer;
+
+        timer_coalescer* m_coalescer = nullptr;
+        buckets_type::iterator m_bucket;
+        handler_type m_handler;
+    };
+
+    explicit timer_coalescer(asio::io_context& ctx, double slack = 0.05) : m_ctx(ctx), m_slack(slack) {
+        assert(slack >= 0.0);
+    }
+
+    timer_coalescer(const timer_coalescer&) = delete;
+    timer_coalescer& operator=(const timer_coalescer&) = delete;
+
+    ~timer_coalescer() {
+        for (auto& [deadline, b] : m_buckets) {
+            while (b.waiters.linked()) {
+                auto& w = static_cast<waiter&>(*b.waiters.next);
+                w.unlink();
+                w.m_coalescer = nullptr;
+                w.m_handler = nullptr;
+            }
+        }
+    }
+
+    asio::io_context& context() { return m_ctx; }
+    double slack() const { return m_slack; }
+    // number of underlying steady_timers currently armed.
+    std::size_t buckets() const { return m_buckets.size(); }
+
+    // Deadline timer armed for timeout d would actually fire at.
+    std::chrono::steady_clock::time_point coalesced_deadline(duration timeout) const {
+        const auto deadline = std::chrono::steady_clock::now() + timeout;
+        const auto slack = static_cast<std::uint64_t>(static_cast<double>(timeout.count()) * m_slack);
+        if (slack <= 1) {
+            return deadline;
+        }
+        const auto granularity = static_cast<duration::rep>(std::bit_floor(slack));
+        const auto since_epoch = deadline.time_since_epoch().count();
+        return std::chrono::steady_clock::time_point(
+            duration((since_epoch + granularity - 1) / granularity * granularity));
+    }
+
+    void async_wait(waiter& w, duration timeout, handler_type handler) {
+        assert(!w.armed());
+        const auto deadline = coalesced_deadline(timeout);
+        auto it = m_buckets.find(deadline);
+        if (it == m_buckets.end()) {
+            it = m_buckets.emplace_hint(it, std::piecewise_construct, std::forward_as_tuple(deadline),
+                                        std::forward_as_tuple(m_ctx, ++m_last_id));
+            it->second.timer.expires_at(deadline);
+            it->second.timer.async_wait([this, deadline, id = it->second.id](std::error_code ec) {
+                // bucket may be gone and even replaced by another one with the same deadline.
+                if (ec) {
+                    return;
+                }
+                auto it = m_buckets.find(deadline);
+                if (it != m_buckets.end() && it->second.id == id) {
+                    fire(it);
+                }
+            });
+        }
+        w.m_coalescer = this;
+        w.m_bucket = it;
+        w.m_handler = std::move(handler);
+        it->second.waiters.push_back(w);
+    }
+
+    // Same as steady_timer::cancel(): handler of pending wait gets posted with operation_aborted.
+    void cancel(waiter& w) {
+        if (!w.armed()) {
+            return;
+        }
+        asio::post(m_ctx, [handler = forget(w)]() mutable { handler(make_error_code(asio::error::operation_aborted)); });
+    }
+
+    // Drops pending wait without calling its handler.
+    void discard(waiter& w) {
+        if (w.armed()) {
+            forget(w);
+        }
+    }
+
+   private:
+    handler_type forget(waiter& w) {
+        w.unlink();
+        // waiter already taken out of its bucket by fire() has nothing to clean up there.
+        if (w.m_bucket != m_buckets.end()) {
+            auto& b = w.m_bucket->second;
+            if (!b.waiters.linked()) {
+                b.timer.cancel();
+                m_buckets.erase(w.m_bucket);
+            }
+        }
+        return std::move(w.m_handler);
+    }
+
+    void fire(buckets_type::iterator it) {
+        // handlers may start, cancel or destroy other waits, so the bucket is detached first.
+        waiter_link expired;
+        while (it->second.waiters.linked()) {
+            auto& w = static_cast<waiter&>(*it->second.waiters.next);
+            w.unlink();
+            w.m_bucket = m_buckets.end();
+            expired.push_back(w);
+        }
+        m_buckets.erase(it);
+
+        while (expired.linked()) {
+            auto& w = static_cast<waiter&>(*expired.next);
+            w.unlink();
+            auto handler = std::move(w.m_handler);
+            handler(std::error_code());
+        }
+    }
+
+    asio::io_context& m_ctx;
+    const double m_slack;
+    buckets_type m_buckets;
+    std::uint64_t m_last_id = 0;
+};
+
+// Subset of asio::steady_timer interface backed by timer_coalescer, including cancel() semantics.
+class coalesced_timer {
+   public:
+    explicit coalesced_timer(timer_coalescer& coalescer) : m_coalescer(coalescer) {}
+    coalesced_timer(const coalesced_timer&) = delete;
+    coalesced_timer& operator=(const coalesced_timer&) = delete;
+
+    // like with steady_timer, pending wait is cancelled.
+    void expires_after(timer_coalescer::duration timeout) {
+        m_coalescer.cancel(m_waiter);
+        m_timeout = timeout;
+    }
+
+    // only one wait may be pending at a time.
+    template <class Handler>
+    void async_wait(Handler&& handler) {
+        m_coalescer.async_wait(m_waiter, m_timeout, std::forward<Handler>(handler));
+    }
+
+    void cancel() { m_coalescer.cancel(m_waiter); }
+
+   private:
+    timer_coalescer& m_coalescer;
+    timer_coalescer::waiter m_waiter;
+    timer_coalescer::duration m_timeout{};
+};
+
+}  // namespace lsem::async
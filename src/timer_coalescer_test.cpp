@@ -0,0 +1,189 @@
+#include "timer_coalescer.hpp"
+#include "async_retry.hpp"
+#include "async_timeoutable.hpp"
+
+#include <asio/io_context.hpp>
+#include <asio/post.hpp>
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <vector>
+
+using namespace std::chrono_literals;
+using namespace lsem::async;
+
+namespace {
+std::chrono::milliseconds elapsed_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+}
+}  // namespace
+
+TEST(timer_coalescer_tests, close_deadlines_share_wakeup) {
+    asio::io_context ctx;
+    // 50% slack of ~100ms gives 32ms granularity (2^25 ns), so these land in at most two buckets.
+    timer_coalescer coalescer(ctx, 0.5);
+
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<std::chrono::milliseconds> fired_at;
+    std::vector<std::unique_ptr<coalesced_timer>> timers;
+    for (auto timeout : {100ms, 101ms, 102ms, 103ms, 104ms, 105ms}) {
+        auto& t = timers.emplace_back(std::make_unique<coalesced_timer>(coalescer));
+        t->expires_after(timeout);
+        t->async_wait([&](std::error_code ec) {
+            EXPECT_FALSE(ec);
+            fired_at.push_back(elapsed_since(start));
+        });
+    }
+    EXPECT_LE(coalescer.buckets(), 2);
+
+    ctx.run();
+
+    ASSERT_EQ(fired_at.size(), 6);
+    for (auto t : fired_at) {
+        EXPECT_GE(t, 100ms);
+        EXPECT_LT(t, 160ms);
+    }
+    EXPECT_EQ(coalescer.buckets(), 0);
+}
+
+TEST(timer_coalescer_tests, zero_slack_is_exact) {
+    asio::io_context ctx;
+    timer_coalescer coalescer(ctx, 0.0);
+
+    const auto timeout = 10ms;
+    const auto expected = std::chrono::steady_clock::now() + timeout;
+    EXPECT_LT(coalescer.coalesced_deadline(timeout) - expected, 1ms);
+}
+
+TEST(timer_coalescer_tests, cancel_reports_operation_aborted) {
+    asio::io_context ctx;
+    timer_coalescer coalescer(ctx, 0.05);
+
+    std::vector<std::error_code> results;
+    coalesced_timer t1(coalescer), t2(coalescer);
+    t1.expires_after(50ms);
+    t2.expires_after(50ms);
+    t1.async_wait([&](std::error_code ec) { results.push_back(ec); });
+    t2.async_wait([&](std::error_code ec) { results.push_back(ec); });
+    t1.cancel();
+
+    ctx.run();
+    EXPECT_EQ(results, (std::vector<std::error_code>{make_error_code(asio::error::operation_aborted),
+                                                     std::error_code()}));
+}
+
+TEST(timer_coalescer_tests, destroyed_waiter_leaves_its_bucket) {
+    asio::io_context ctx;
+    timer_coalescer coalescer(ctx, 0.05);
+
+    std::vector<std::error_code> results;
+    timer_coalescer::waiter kept;
+    coalescer.async_wait(kept, 20ms, [&](std::error_code ec) { results.push_back(ec); });
+    {
+        timer_coalescer::waiter dropped;
+        coalescer.async_wait(dropped, 20ms, [](std::error_code) { ADD_FAILURE() << "handler of dropped wait called"; });
+        EXPECT_TRUE(dropped.armed());
+    }
+    {
+        // the only waiter of its bucket takes the bucket with it.
+        timer_coalescer::waiter dropped;
+        coalescer.async_wait(dropped, 1s, [](std::error_code) { ADD_FAILURE() << "handler of dropped wait called"; });
+        EXPECT_EQ(coalescer.buckets(), 2);
+    }
+    EXPECT_EQ(coalescer.buckets(), 1);
+
+    ctx.run();
+    EXPECT_EQ(results, std::vector<std::error_code>{std::error_code()});
+}
+
+TEST(timer_coalescer_tests, waiter_may_outlive_coalescer) {
+    asio::io_context ctx;
+    timer_coalescer::waiter w;
+    {
+        timer_coalescer coalescer(ctx, 0.05);
+        coalescer.async_wait(w, 1s, [](std::error_code) { ADD_FAILURE() << "handler of dropped wait called"; });
+    }
+    EXPECT_FALSE(w.armed());
+    ctx.run();
+}
+
+TEST(timer_coalescer_tests, handler_may_cancel_and_destroy_sibling_of_its_bucket) {
+    asio::io_context ctx;
+    timer_coalescer coalescer(ctx, 0.5);
+
+    std::vector<std::error_code> results;
+    auto first = std::make_unique<coalesced_timer>(coalescer);
+    auto cancelled = std::make_unique<coalesced_timer>(coalescer);
+    auto destroyed = std::make_unique<coalesced_timer>(coalescer);
+    for (auto* t : {first.get(), cancelled.get(), destroyed.get()}) {
+        t->expires_after(100ms);
+    }
+    first->async_wait([&](std::error_code ec) {
+        results.push_back(ec);
+        // both already expired together with this one, but their handlers did not run yet.
+        cancelled->cancel();
+        destroyed.reset();
+    });
+    cancelled->async_wait([&](std::error_code ec) { results.push_back(ec); });
+    destroyed->async_wait([](std::error_code) { ADD_FAILURE() << "handler of destroyed timer called"; });
+    ASSERT_EQ(coalescer.buckets(), 1);
+
+    ctx.run();
+    EXPECT_EQ(results, (std::vector<std::error_code>{std::error_code(),
+                                                     make_error_code(asio::error::operation_aborted)}));
+    EXPECT_EQ(coalescer.buckets(), 0);
+}
+
+TEST(timer_coalescer_tests, async_timeoutable_with_coalescer) {
+    asio::io_context ctx;
+    timer_coalescer coalescer(ctx, 0.1);
+
+    auto async_op = [&ctx](bool reply, auto done) {
+        if (reply) {
+            asio::post(ctx, [done] { done(std::error_code(), 1); });
+        }
+    };
+
+    std::vector<std::error_code> results;
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 10; ++i) {
+        async_timeoutable(coalescer, async_op)(20ms, i % 2 == 0, [&](std::error_code ec, int) {
+            results.push_back(ec);
+        });
+    }
+    ctx.run();
+
+    EXPECT_EQ(std::count(results.begin(), results.end(), std::error_code()), 5);
+    EXPECT_EQ(std::count(results.begin(), results.end(), make_error_code(std::errc::timed_out)), 5);
+    EXPECT_GE(elapsed_since(start), 20ms);
+    EXPECT_LT(elapsed_since(start), 40ms);
+}
+
+TEST(timer_coalescer_tests, async_retry_pauses_in_coalescer) {
+    asio::io_context ctx;
+    auto coalescer = std::make_shared<timer_coalescer>(ctx, 0.2);
+
+    int called_times = 0;
+    auto async_op = [&called_times](asio::io_context& ctx, auto done_cb) {
+        // every instance fails its first attempt.
+        done_cb(++called_times <= 4 ? make_error_code(std::errc::io_error) : std::error_code());
+    };
+
+    std::vector<std::error_code> results;
+    const auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < 4; ++i) {
+        async_retry(ctx, async_op, {.attempts = 2, .pause = 30ms, .pause_coalescer = coalescer})(
+            ctx, [&](std::error_code ec) { results.push_back(ec); });
+    }
+    EXPECT_LE(coalescer->buckets(), 2);
+    ctx.run();
+
+    EXPECT_EQ(results, std::vector<std::error_code>(4));
+    EXPECT_EQ(called_times, 8);
+    EXPECT_GE(elapsed_since(start), 30ms);
+    EXPECT_LT(elapsed_since(start), 50ms);
+}
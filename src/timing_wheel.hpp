@@ -0,0 +1,260 @@
+#pragma once
+
+#include <asio/io_context.hpp>
+#include <asio/steady_timer.hpp>
+
+#include <function2/function2.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <system_error>
+#include <utility>
+
+namespace lsem::async {
+
+// Hierarchical timing wheel: many timeouts of one io_context driven by a single steady_timer. Arming and disarming
+// is O(1) (intrusive list insert/unlink), instead of O(log n) heap operations and cancel dispatch of a steady_timer
+// per timeout. Expirations are rounded up to tick, so entry fires between timeout and timeout + tick after arming.
+//
+// There are 4 levels of 64 slots, level N slot covers 64^N ticks. Entries further than 64^4 ticks away are parked in
+// the last level and cascaded down as time goes. Driving timer only runs while something is armed, so an idle wheel
+// does not keep io_context::run() from returning.
+//
+// Not thread safe, to be used from the thread(s) running its io_context serially. Must outlive everything armed in
+// it and the io_context run loop.
+class timing_wheel {
+    struct link {
+        link() : prev(this), next(this) {}
+        link(const link&) = delete;
+        link& operator=(const link&) = delete;
+
+        bool linked() const { return next != this; }
+
+        void unlink() {
+            prev->next = next;
+            next->prev = prev;
+            prev = next = this;
+        }
+
+        void push_back(link& l) {
+            l.prev = prev;
+            l.next = this;
+            prev->next = &l;
+            prev = &l;
+        }
+
+        link* prev;
+        link* next;
+    };
+
+   public:
+    using duration = std::chrono::steady_clock::duration;
+    using callback_type = fu2::unique_function<void()>;
+
+    // Storage of one armed timeout, owned by the user. Disarms itself when destroyed.
+    class entry : private link {
+       public:
+        entry() = default;
+        ~entry() {
+            if (m_wheel) {
+                m_wheel->disarm(*this);
+            }
+        }
+
+        bool armed() const { return linked(); }
+
+       private:
+        friend class timing_wheel;
+
+        timing_wheel* m_wheel = nullptr;
+        std::uint64_t m_expiry = 0;
+        callback_type m_on_expired;
+    };
+
+    explicit timing_wheel(asio::io_context& ctx, duration tick = std::chrono::milliseconds(10))
+        : m_tick(tick), m_origin(std::chrono::steady_clock::now()), m_driver(ctx) {
+        assert(tick > duration::zero());
+    }
+
+    timing_wheel(const timing_wheel&) = delete;
+    timing_wheel& operator=(const timing_wheel&) = delete;
+
+    ~timing_wheel() {
+        for (auto& level : m_slots) {
+            for (auto& slot : level) {
+                while (slot.linked()) {
+                    auto& e = static_cast<entry&>(*slot.next);
+                    e.unlink();
+                    e.m_wheel = nullptr;
+                    e.m_on_expired = nullptr;
+                }
+            }
+        }
+    }
+
+    // Calls on_expired once timeout passed unless entry is disarmed before. Rearming armed entry moves it.
+    void arm(entry& e, duration timeout, callback_type on_expired) {
+        disarm(e);
+        if (m_size == 0) {
+            // nothing happened while idle, so skipping idle ticks loses nothing.
+            m_now = ticks_at(std::chrono::steady_clock::now());
+        }
+        // round up, so entry never fires early.
+        const auto since_origin = std::chrono::steady_clock::now() + timeout - m_origin;
+        const auto expiry = static_cast<std::uint64_t>((since_origin + m_tick - duration(1)) / m_tick);
+        e.m_expiry = std::max(m_now + 1, expiry);
+        e.m_wheel = this;
+        e.m_on_expired = std::move(on_expired);
+        place(e);
+        if (m_size++ == 0 || e.m_expiry < m_wakeup) {
+            schedule();
+        }
+    }
+
+    // Forgets entry and its callback without calling it. Does nothing for entry that is not armed.
+    void disarm(entry& e) {
+        if (!e.armed()) {
+            return;
+        }
+        e.unlink();
+        e.m_on_expired = nullptr;
+        if (--m_size == 0) {
+            // let io_context run out of work.
+            ++m_generation;
+            m_driver.cancel();
+        }
+    }
+
+    duration tick() const { return m_tick; }
+    std::size_t size() const { return m_size; }
+
+   private:
+    static constexpr unsigned slot_bits = 6;
+    static constexpr std::size_t slots_per_level = std::size_t{1} << slot_bits;
+    static constexpr std::size_t levels = 4;
+    static constexpr std::uint64_t slot_mask = slots_per_level - 1;
+    static constexpr std::uint64_t max_delta = (std::uint64_t{1} << (slot_bits * levels)) - 1;
+
+    std::uint64_t ticks_at(std::chrono::steady_clock::time_point t) const {
+        return static_cast<std::uint64_t>((t - m_origin) / m_tick);
+    }
+
+    void place(entry& e) {
+        const std::uint64_t delta = std::min(e.m_expiry - m_now, max_delta);
+        const std::uint64_t target = m_now + delta;
+        std::size_t level = 0;
+        while (level + 1 < levels && delta >= (std::uint64_t{1} << (slot_bits * (level + 1)))) {
+            ++level;
+        }
+        m_slots[level][(target >> (slot_bits * level)) & slot_mask].push_back(e);
+    }
+
+    // Moves entries of higher level slot whose turn has come down to lower levels.
+    void cascade(std::size_t level) {
+        link pending;
+        auto& slot = m_slots[level][(m_now >> (slot_bits * level)) & slot_mask];
+        while (slot.linked()) {
+            auto& l = *slot.next;
+            l.unlink();
+            pending.push_back(l);
+        }
+        while (pending.linked()) {
+            auto& e = static_cast<entry&>(*pending.next);
+            e.unlink();
+            place(e);
+        }
+    }
+
+    void step() {
+        ++m_now;
+        for (std::size_t level = 1; level < levels; ++level) {
+            if ((m_now & ((std::uint64_t{1} << (slot_bits * level)) - 1)) != 0) {
+                break;
+            }
+            cascade(level);
+        }
+
+        // callbacks may arm or disarm anything, including entries of this slot, so take them one by one.
+        link expired;
+        auto& slot = m_slots[0][m_now & slot_mask];
+        while (slot.linked()) {
+            auto& l = *slot.next;
+            l.unlink();
+            expired.push_back(l);
+        }
+        while (expired.linked()) {
+            auto& e = static_cast<entry&>(*expired.next);
+            e.unlink();
+            auto on_expired = std::move(e.m_on_expired);
+            e.m_on_expired = nullptr;
+            m_size--;
+            on_expired();
+        }
+    }
+
+    // Earliest tick worth waking up for: next non-empty level 0 slot or next cascade.
+    std::uint64_t next_wakeup() const {
+        const std::uint64_t boundary = (m_now | slot_mask) + 1;
+        for (std::uint64_t t = m_now + 1; t < boundary; ++t) {
+            if (m_slots[0][t & slot_mask].linked()) {
+                return t;
+            }
+        }
+        return boundary;
+    }
+
+    void schedule() {
+        m_wakeup = next_wakeup();
+        m_driver.expires_at(m_origin + m_tick * static_cast<duration::rep>(m_wakeup));
+        m_driver.async_wait([this, generation = ++m_generation](std::error_code ec) {
+            if (ec || generation != m_generation) {
+                return;
+            }
+            const auto target = ticks_at(std::chrono::steady_clock::now());
+            while (m_now < target && m_size > 0) {
+                step();
+            }
+            if (m_size > 0 && generation == m_generation) {
+                schedule();
+            }
+        });
+    }
+
+    const duration m_tick;
+    const std::chrono::steady_clock::time_point m_origin;
+    asio::steady_timer m_driver;
+    std::array<std::array<link, slots_per_level>, levels> m_slots;
+    std::uint64_t m_now = 0;
+    // tick driving timer is set to.
+    std::uint64_t m_wakeup = 0;
+    std::uint64_t m_generation = 0;
+    std::size_t m_size = 0;
+};
+
+// Subset of asio::steady_timer interface backed by timing_wheel, so wheel can be used where steady_timer is. Unlike
+// steady_timer, cancel() drops the handler instead of calling it with operation_aborted.
+class wheel_timer {
+   public:
+    explicit wheel_timer(timing_wheel& wheel) : m_wheel(wheel) {}
+
+    void expires_after(timing_wheel::duration timeout) { m_timeout = timeout; }
+
+    template <class Handler>
+    void async_wait(Handler&& handler) {
+        m_wheel.arm(m_entry, m_timeout,
+                    [handler = std::forward<Handler>(handler)]() mutable { handler(std::error_code()); });
+    }
+
+    void cancel() { m_wheel.disarm(m_entry); }
+
+   private:
+    timing_wheel& m_wheel;
+    timing_wheel::entry m_entry;
+    timing_wheel::duration m_timeout{};
+};
+
+}  // namespace lsem::async
@@ -0,0 +1,137 @@
+#include "timing_wheel.hpp"
+#include "async_timeoutable.hpp"
+
+#include <asio/io_context.hpp>
+#include <asio/steady_timer.hpp>
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <tuple>
+#include <vector>
+
+using namespace std::chrono_literals;
+using namespace lsem::async;
+
+namespace {
+std::chrono::milliseconds elapsed_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start);
+}
+}  // namespace
+
+TEST(timing_wheel_tests, entries_fire_in_order_after_timeout) {
+    asio::io_context ctx;
+    timing_wheel wheel(ctx, 1ms);
+
+    const auto start = std::chrono::steady_clock::now();
+    std::vector<int> fired;
+    std::vector<std::chrono::milliseconds> fired_at;
+
+    // 150ms and 300ms do not fit level 0 and have to be cascaded.
+    timing_wheel::entry e1, e2, e3, e4;
+    wheel.arm(e3, 150ms, [&] {
+        fired.push_back(3);
+        fired_at.push_back(elapsed_since(start));
+    });
+    wheel.arm(e1, 5ms, [&] {
+        fired.push_back(1);
+        fired_at.push_back(elapsed_since(start));
+    });
+    wheel.arm(e4, 300ms, [&] {
+        fired.push_back(4);
+        fired_at.push_back(elapsed_since(start));
+    });
+    wheel.arm(e2, 40ms, [&] {
+        fired.push_back(2);
+        fired_at.push_back(elapsed_since(start));
+    });
+    EXPECT_EQ(wheel.size(), 4);
+
+    ctx.run();
+
+    EXPECT_EQ(fired, (std::vector<int>{1, 2, 3, 4}));
+    ASSERT_EQ(fired_at.size(), 4);
+    EXPECT_GE(fired_at[0], 5ms);
+    EXPECT_GE(fired_at[1], 40ms);
+    EXPECT_GE(fired_at[2], 150ms);
+    EXPECT_GE(fired_at[3], 300ms);
+    EXPECT_LT(fired_at[3], 340ms);
+    EXPECT_EQ(wheel.size(), 0);
+    EXPECT_FALSE(e1.armed());
+}
+
+TEST(timing_wheel_tests, disarmed_entry_does_not_fire) {
+    asio::io_context ctx;
+    timing_wheel wheel(ctx, 1ms);
+
+    bool fired = false;
+    timing_wheel::entry e;
+    wheel.arm(e, 20ms, [&] { fired = true; });
+    EXPECT_TRUE(e.armed());
+    wheel.disarm(e);
+    EXPECT_FALSE(e.armed());
+
+    // idle wheel lets run() return right away.
+    const auto start = std::chrono::steady_clock::now();
+    ctx.run();
+    EXPECT_LT(elapsed_since(start), 10ms);
+    EXPECT_FALSE(fired);
+}
+
+TEST(timing_wheel_tests, destroyed_entry_is_disarmed) {
+    asio::io_context ctx;
+    timing_wheel wheel(ctx, 1ms);
+
+    bool fired = false;
+    auto e = std::make_unique<timing_wheel::entry>();
+    wheel.arm(*e, 10ms, [&] { fired = true; });
+    e = nullptr;
+    EXPECT_EQ(wheel.size(), 0);
+
+    ctx.run();
+    EXPECT_FALSE(fired);
+}
+
+TEST(timing_wheel_tests, callback_can_rearm_and_disarm) {
+    asio::io_context ctx;
+    timing_wheel wheel(ctx, 1ms);
+
+    int fired = 0;
+    bool other_fired = false;
+    timing_wheel::entry e, other;
+    wheel.arm(other, 10ms, [&] { other_fired = true; });
+    std::function<void()> on_expired = [&] {
+        if (++fired < 2) {
+            wheel.arm(e, 5ms, on_expired);
+        } else {
+            wheel.disarm(other);
+        }
+    };
+    wheel.arm(e, 2ms, on_expired);
+
+    ctx.run();
+    EXPECT_EQ(fired, 2);
+    EXPECT_FALSE(other_fired);
+}
+
+TEST(timing_wheel_tests, async_timeoutable_with_wheel) {
+    asio::io_context ctx;
+    timing_wheel wheel(ctx, 1ms);
+
+    auto async_op = [&ctx](std::chrono::steady_clock::duration delay, auto done) {
+        auto timer = std::make_shared<asio::steady_timer>(ctx, delay);
+        timer->async_wait([timer, done](std::error_code) { done(std::error_code(), 42); });
+    };
+
+    std::optional<std::tuple<std::error_code, int>> in_time, too_late;
+    async_timeoutable(wheel, async_op)(50ms, 5ms, [&](std::error_code ec, int r) { in_time.emplace(ec, r); });
+    async_timeoutable(wheel, async_op)(5ms, 50ms, [&](std::error_code ec, int r) { too_late.emplace(ec, r); });
+    ctx.run();
+
+    EXPECT_EQ(in_time, std::tuple(std::error_code(), 42));
+    EXPECT_EQ(too_late, std::tuple(make_error_code(std::errc::timed_out), 0));
+    EXPECT_EQ(wheel.size(), 0);
+}
@@ -1,8 +1,10 @@
 #pragma once
 
+#include <cstddef>
 #include <system_error>
 #include <tuple>
 #include <type_traits>
+#include <utility>
 
 #define FWD(...) std::forward<decltype(__VA_ARGS__)>(__VA_ARGS__)
 
@@ -48,6 +50,68 @@ struct result_type<void (ClassType::*)(std::error_code)> {
 template <typename AsioLikeCallable>
 using result_type_t = typename result_type<AsioLikeCallable>::type;
 
+// All values completion handler receives after error_code: void(std::error_code, Ts...) gives std::tuple<Ts...>.
+template <class T>
+struct completion_args : public completion_args<decltype(&T::operator())> {};
+
+template <class ClassType, class... Ts>
+struct completion_args<void (ClassType::*)(std::error_code, Ts...) const> {
+    using type = std::tuple<std::decay_t<Ts>...>;
+};
+
+template <class ClassType, class... Ts>
+struct completion_args<void (ClassType::*)(std::error_code, Ts...)> {
+    using type = std::tuple<std::decay_t<Ts>...>;
+};
+
+// Handler taking only error_code needs no introspection, so it may be generic lambda.
+template <typename AsioLikeCallable>
+constexpr auto completion_args_of() {
+    if constexpr (std::is_invocable_v<AsioLikeCallable, std::error_code>) {
+        return std::type_identity<std::tuple<>>{};
+    } else {
+        return std::type_identity<typename completion_args<AsioLikeCallable>::type>{};
+    }
+}
+
+template <typename AsioLikeCallable>
+using completion_args_t = typename decltype(completion_args_of<AsioLikeCallable>())::type;
+
+// Number of values after error_code handler accepts, found by probing it with default_val, so generic lambdas
+// work as well. Gives max_completion_arity + 1 when nothing fits.
+constexpr std::size_t max_completion_arity = 8;
+
+template <std::size_t>
+using default_val_ref = default_val&;
+
+template <class Handler, std::size_t... Ints>
+constexpr bool invocable_with_defaults(std::index_sequence<Ints...>) {
+    return std::is_invocable_v<Handler, std::error_code, default_val_ref<Ints>...>;
+}
+
+template <class Handler, std::size_t N = 0>
+constexpr std::size_t completion_arity() {
+    if constexpr (N > max_completion_arity || invocable_with_defaults<Handler>(std::make_index_sequence<N>{})) {
+        return N;
+    } else {
+        return completion_arity<Handler, N + 1>();
+    }
+}
+
+template <class Handler>
+constexpr std::size_t completion_arity_v = completion_arity<Handler>();
+
+// Calls handler with ec and default values for everything else, e.g. to report an error.
+template <class Handler, std::size_t... Ints>
+void invoke_with_defaults(Handler& handler, std::error_code ec, std::index_sequence<Ints...>) {
+    handler(ec, (static_cast<void>(Ints), default_val{})...);
+}
+
+template <std::size_t N, class Handler>
+void invoke_with_defaults(Handler& handler, std::error_code ec) {
+    invoke_with_defaults(handler, ec, std::make_index_sequence<N>{});
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 template <std::size_t N, typename Seq>
 struct offset_sequence;